@@ -0,0 +1,772 @@
+/*
+  ==============================================================================
+
+    Headless benchmarks for the ReShimmer DSP: the stretcher, the FFTs, the
+    plugin's latency/quality settings, the reverb (against the Freeverb that
+    juce::dsp::Reverb runs) and the whole wet chain (pitch voices -> voice mix
+    -> reverb -> dry/wet).
+
+    The switching cases also count allocations, and the run fails if switching
+    settings live allocates anything (CTest runs those).
+
+    Everything here is header-only DSP, so it builds without JUCE.  Results are
+    written as JSON, so runs can be compared automatically:
+
+        reshimmer-benchmark [--quick] [--seconds <s>] [--filter <text>] [--output <file>]
+
+  ==============================================================================
+*/
+
+#include "stretch/signalsmith-stretch.h"
+#include "stretch/dsp/fft.h"
+#include "ShimmerReverb.h"
+#include "StretchSettings.h"
+#include "WetDecimator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // every allocation in the process, so a case can check that its timed part doesn't allocate
+    std::atomic<long> allocationCount { 0 };
+}
+
+void* operator new(std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+// (GCC sees these inlined into delete-expressions, and doesn't realise they're paired with the operator new above)
+#if defined(__GNUC__) && ! defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+#if defined(__GNUC__) && ! defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Options
+    {
+        double seconds = 4.0;       // audio processed per stretch/chain case
+        double sampleRate = 48000.0;
+        std::string filter;
+        std::string outputFile;
+        bool quick = false;
+    };
+
+    // One benchmark result: the timing of every call, plus how much audio each call covered (0 for non-audio cases)
+    struct Result
+    {
+        std::string group, name;
+        std::vector<std::pair<std::string, std::string>> parameters;
+        std::vector<double> callSeconds;
+        double audioSecondsPerCall = 0.0;
+        // only counted by cases which mustn't allocate (anything above 0 fails the run)
+        long allocations = 0;
+    };
+
+    std::string jsonString(const std::string& text)
+    {
+        std::string escaped = "\"";
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            escaped += c;
+        }
+        return escaped + "\"";
+    }
+
+    std::string jsonNumber(double value)
+    {
+        if (! std::isfinite(value))
+            return "null";
+        std::ostringstream stream;
+        stream.precision(6);
+        stream << value;
+        return stream.str();
+    }
+
+    void writeJson(std::ostream& out, const Options& options, const std::vector<Result>& results)
+    {
+        out << "{\n";
+        out << "  \"version\": 1,\n";
+        out << "  \"sampleRate\": " << jsonNumber(options.sampleRate) << ",\n";
+        out << "  \"results\": [";
+        for (size_t r = 0; r < results.size(); ++r)
+        {
+            const Result& result = results[r];
+            std::vector<double> sorted = result.callSeconds;
+            std::sort(sorted.begin(), sorted.end());
+
+            double total = 0.0;
+            for (double t : sorted)
+                total += t;
+            const double mean = sorted.empty() ? 0.0 : total / sorted.size();
+            const double p99 = sorted.empty() ? 0.0 : sorted[std::min(sorted.size() - 1, (size_t) std::ceil(0.99 * sorted.size()) - 1)];
+            const double max = sorted.empty() ? 0.0 : sorted.back();
+
+            out << (r ? ",\n" : "\n") << "    {";
+            out << "\"group\": " << jsonString(result.group) << ", \"name\": " << jsonString(result.name);
+            for (auto& parameter : result.parameters)
+                out << ", " << jsonString(parameter.first) << ": " << parameter.second;
+            out << ", \"calls\": " << sorted.size();
+            out << ", \"meanMs\": " << jsonNumber(mean * 1000.0);
+            out << ", \"p99Ms\": " << jsonNumber(p99 * 1000.0);
+            out << ", \"maxMs\": " << jsonNumber(max * 1000.0);
+            // CPU time as a fraction of the audio's duration: 1 means exactly real-time, smaller is better
+            if (result.audioSecondsPerCall > 0.0)
+                out << ", \"realTimeFactor\": " << jsonNumber(mean / result.audioSecondsPerCall);
+            out << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    // Deterministic test signal: a couple of partials plus some noise, different on every channel
+    void fillInput(std::vector<std::vector<float>>& channels, double sampleRate)
+    {
+        unsigned seed = 12345;
+        for (size_t c = 0; c < channels.size(); ++c)
+        {
+            const double freq1 = 220.0 * (1 + c), freq2 = 1234.5 + 17.0 * c;
+            auto& channel = channels[c];
+            for (size_t i = 0; i < channel.size(); ++i)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                const float noise = (seed >> 8) / float(1 << 24) - 0.5f;
+                const double t = i / sampleRate;
+                channel[i] = (float) (0.4 * std::sin(2 * M_PI * freq1 * t) + 0.2 * std::sin(2 * M_PI * freq2 * t)) + 0.05f * noise;
+            }
+        }
+    }
+
+    std::string quoted(const char* text)
+    {
+        return jsonString(text);
+    }
+
+    std::string number(double value)
+    {
+        return jsonNumber(value);
+    }
+
+    //==============================================================================
+    Result benchmarkStretch(const Options& options, bool cheaper, int numChannels, int semitones, int blockSize)
+    {
+        Result result;
+        result.group = "stretch";
+        result.name = std::string(cheaper ? "cheaper" : "default") + "/" + std::to_string(numChannels) + "ch/"
+            + (semitones > 0 ? "+" : "") + std::to_string(semitones) + "st/" + std::to_string(blockSize);
+        result.parameters = {
+            {"preset", quoted(cheaper ? "cheaper" : "default")},
+            {"channels", number(numChannels)},
+            {"semitones", number(semitones)},
+            {"blockSize", number(blockSize)}
+        };
+        result.audioSecondsPerCall = blockSize / options.sampleRate;
+
+        signalsmith::stretch::SignalsmithStretch<float> stretch;
+        if (cheaper)
+            stretch.presetCheaper(numChannels, (float) options.sampleRate);
+        else
+            stretch.presetDefault(numChannels, (float) options.sampleRate);
+        stretch.setTransposeSemitones((float) semitones, (float) (8000.0 / options.sampleRate));
+
+        const int totalSamples = std::max(blockSize, (int) (options.seconds * options.sampleRate));
+        std::vector<std::vector<float>> input(numChannels, std::vector<float>(totalSamples + blockSize));
+        std::vector<std::vector<float>> output(numChannels, std::vector<float>(blockSize));
+        fillInput(input, options.sampleRate);
+
+        std::vector<const float*> inputPointers(numChannels);
+        std::vector<float*> outputPointers(numChannels);
+        for (int c = 0; c < numChannels; ++c)
+            outputPointers[c] = output[c].data();
+
+        // warm up past the initial latency, so every timed block is doing real work
+        const int warmupSamples = stretch.blockSamples() + stretch.intervalSamples();
+        for (int start = 0; start < totalSamples; start += blockSize)
+        {
+            for (int c = 0; c < numChannels; ++c)
+                inputPointers[c] = input[c].data() + start;
+
+            const auto startTime = Clock::now();
+            stretch.process(inputPointers.data(), blockSize, outputPointers.data(), blockSize);
+            const auto endTime = Clock::now();
+
+            if (start >= warmupSamples)
+                result.callSeconds.push_back(std::chrono::duration<double>(endTime - startTime).count());
+        }
+        return result;
+    }
+
+    //==============================================================================
+    template <bool isReal>
+    Result benchmarkFft(const Options& options, int size)
+    {
+        Result result;
+        result.group = isReal ? "realfft" : "fft";
+        result.name = result.group + "/" + std::to_string(size);
+        result.parameters = {{"size", number(size)}};
+
+        using Input = typename std::conditional<isReal, float, std::complex<float>>::type;
+        typename std::conditional<isReal, signalsmith::fft::RealFFT<float>, signalsmith::fft::FFT<float>>::type fft(size);
+        std::vector<Input> time(size);
+        std::vector<std::complex<float>> freq(size);
+        for (int i = 0; i < size; ++i)
+            time[i] = Input(std::sin(0.1f * i));
+
+        // enough calls for a stable mean, without the big sizes taking forever
+        const int calls = std::max(50, std::min(20000, (int) (2.0e7 * (options.quick ? 0.1 : 1.0) / size)));
+        for (int i = 0; i < calls; ++i)
+        {
+            const auto startTime = Clock::now();
+            fft.fft(time, freq);
+            fft.ifft(freq, time);
+            const auto endTime = Clock::now();
+            result.callSeconds.push_back(std::chrono::duration<double>(endTime - startTime).count());
+
+            // keep the values bounded, since forward+inverse scales by the size
+            const float scale = 1.0f / size;
+            for (auto& t : time)
+                t *= scale;
+        }
+        return result;
+    }
+
+    //==============================================================================
+    const char* const latencyNames[StretchSettings::numLatencies] = {"low", "medium", "normal"};
+    const char* const qualityNames[StretchSettings::numQualities] = {"cheaper", "default", "high"};
+
+    // The plugin's stretcher with each of its latency/quality settings, and four of its eight voices active.
+    // Like the plugin, it's amortised when the blocks are shorter than the interval, unless `allowAmortised` is false
+    // (comparing the two shows how much of the interval's work lands in the worst block: see p99Ms and maxMs).
+    Result benchmarkSettings(const Options& options, int latency, int quality, int blockSize, bool allowAmortised = true)
+    {
+        constexpr int numChannels = 2, maxVoices = 8, activeVoices = 4;
+        const int pitches[maxVoices] = {12, 0, 7, 19, -12, 24, 5, -5};
+
+        const auto settings = StretchSettings::forSetting(latency, quality, options.sampleRate);
+        const bool amortised = allowAmortised && settings.shouldAmortise(blockSize);
+        signalsmith::stretch::SignalsmithStretch<float> stretch;
+        stretch.setAmortised(amortised);
+        stretch.configure(numChannels, settings.blockSamples, settings.intervalSamples, maxVoices);
+        for (int v = 0; v < maxVoices; ++v)
+        {
+            stretch.setVoiceTransposeSemitones(v, (float) pitches[v], (float) (8000.0 / options.sampleRate));
+            stretch.setVoiceActive(v, v < activeVoices);
+        }
+
+        Result result;
+        result.group = "settings";
+        result.name = std::string(latencyNames[latency]) + "/" + qualityNames[quality] + "/" + std::to_string(blockSize)
+            + (allowAmortised ? "" : "/unamortised");
+        result.parameters = {
+            {"latency", quoted(latencyNames[latency])},
+            {"quality", quoted(qualityNames[quality])},
+            {"blockSize", number(blockSize)},
+            {"amortised", amortised ? "true" : "false"},
+            {"windowSamples", number(settings.blockSamples)},
+            {"intervalSamples", number(settings.intervalSamples)},
+            // what the plugin reports to the host (the dry signal is delayed to match)
+            {"latencyMs", number((stretch.inputLatency() + stretch.outputLatency()) * 1000.0 / options.sampleRate)}
+        };
+        result.audioSecondsPerCall = blockSize / options.sampleRate;
+
+        const int totalSamples = std::max(blockSize, (int) (options.seconds * options.sampleRate));
+        std::vector<std::vector<float>> input(numChannels, std::vector<float>(totalSamples + blockSize));
+        fillInput(input, options.sampleRate);
+
+        std::vector<std::vector<float>> voiceBuffers(maxVoices * numChannels, std::vector<float>(blockSize));
+        float* voiceChannels[maxVoices][numChannels];
+        float** voiceOutputs[maxVoices];
+        for (int v = 0; v < maxVoices; ++v)
+        {
+            for (int c = 0; c < numChannels; ++c)
+                voiceChannels[v][c] = voiceBuffers[v * numChannels + c].data();
+            voiceOutputs[v] = voiceChannels[v];
+        }
+
+        const int warmupSamples = stretch.blockSamples() + stretch.intervalSamples();
+        for (int start = 0; start < totalSamples; start += blockSize)
+        {
+            const float* inputPointers[numChannels] = {input[0].data() + start, input[1].data() + start};
+
+            const auto startTime = Clock::now();
+            stretch.processVoices(inputPointers, blockSize, voiceOutputs, blockSize);
+            const auto endTime = Clock::now();
+
+            if (start >= warmupSamples)
+                result.callSeconds.push_back(std::chrono::duration<double>(endTime - startTime).count());
+        }
+        return result;
+    }
+
+    // The plugin's live latency/quality changes: every setting is reserved up-front, then the stretcher
+    // is re-configured and reset between blocks every 100ms, cycling through all of them.  Like configureStretch(), each change
+    // re-decides whether to amortise.  None of the processing or switching should allocate.
+    Result benchmarkSwitching(const Options& options, int blockSize)
+    {
+        constexpr int numChannels = 2, maxVoices = 8, activeVoices = 4;
+        constexpr int numSettings = StretchSettings::numLatencies * StretchSettings::numQualities;
+        const int pitches[maxVoices] = {12, 0, 7, 19, -12, 24, 5, -5};
+
+        signalsmith::stretch::SignalsmithStretch<float> stretch;
+        auto configure = [&](int setting) {
+            const auto settings = StretchSettings::forSetting(setting / StretchSettings::numQualities, setting % StretchSettings::numQualities, options.sampleRate);
+            stretch.setAmortised(settings.shouldAmortise(blockSize));
+            stretch.configure(numChannels, settings.blockSamples, settings.intervalSamples, maxVoices);
+        };
+        // each setting is reserved while it's the current one, which is the awkward order for reserve() to cope with
+        for (int setting = numSettings - 1; setting >= 0; --setting)
+        {
+            configure(setting);
+            const auto settings = StretchSettings::forSetting(setting / StretchSettings::numQualities, setting % StretchSettings::numQualities, options.sampleRate);
+            stretch.reserve(numChannels, settings.blockSamples, settings.intervalSamples);
+        }
+        for (int v = 0; v < maxVoices; ++v)
+        {
+            stretch.setVoiceTransposeSemitones(v, (float) pitches[v], (float) (8000.0 / options.sampleRate));
+            stretch.setVoiceActive(v, v < activeVoices);
+        }
+
+        const int totalSamples = std::max(blockSize, (int) (options.seconds * options.sampleRate));
+        std::vector<std::vector<float>> input(numChannels, std::vector<float>(totalSamples + blockSize));
+        fillInput(input, options.sampleRate);
+
+        std::vector<std::vector<float>> voiceBuffers(maxVoices * numChannels, std::vector<float>(blockSize));
+        float* voiceChannels[maxVoices][numChannels];
+        float** voiceOutputs[maxVoices];
+        for (int v = 0; v < maxVoices; ++v)
+        {
+            for (int c = 0; c < numChannels; ++c)
+                voiceChannels[v][c] = voiceBuffers[v * numChannels + c].data();
+            voiceOutputs[v] = voiceChannels[v];
+        }
+
+        Result result;
+        result.callSeconds.reserve(totalSamples / blockSize + 1);
+        const int switchSamples = std::max(blockSize, (int) (0.1 * options.sampleRate));
+        int setting = 0, switches = 0, untilSwitch = switchSamples;
+
+        const long startAllocations = allocationCount.load();
+        for (int start = 0; start < totalSamples; start += blockSize)
+        {
+            const float* inputPointers[numChannels] = {input[0].data() + start, input[1].data() + start};
+
+            const auto startTime = Clock::now();
+            untilSwitch -= blockSize;
+            if (untilSwitch <= 0)
+            {
+                // (stepping by 4 jumps between latencies as well as between neighbouring qualities)
+                setting = (setting + 4) % numSettings;
+                configure(setting);
+                stretch.reset();
+                untilSwitch += switchSamples;
+                ++switches;
+            }
+            stretch.processVoices(inputPointers, blockSize, voiceOutputs, blockSize);
+            const auto endTime = Clock::now();
+
+            result.callSeconds.push_back(std::chrono::duration<double>(endTime - startTime).count());
+        }
+        result.allocations = allocationCount.load() - startAllocations;
+
+        result.group = "switch";
+        result.name = std::to_string(blockSize);
+        result.parameters = {
+            {"blockSize", number(blockSize)},
+            {"switches", number(switches)},
+            {"allocations", number((double) result.allocations)}
+        };
+        result.audioSecondsPerCall = blockSize / options.sampleRate;
+        return result;
+    }
+
+    //==============================================================================
+    // The algorithm juce::dsp::Reverb runs (Freeverb: 8 damped combs and 4 allpasses per channel, with JUCE's
+    // constants), as the reference for the reverb cases.  JUCE itself isn't available here.
+    class FreeverbReference
+    {
+    public:
+        void prepare(double sampleRate, const ShimmerReverbParameters& params)
+        {
+            const int combLengths[numCombs] = {1116, 1188, 1277, 1356, 1422, 1491, 1557, 1617};
+            const int allpassLengths[numAllpasses] = {556, 441, 341, 225};
+            const int stereoSpread = 23;
+            for (int c = 0; c < 2; ++c)
+            {
+                for (int i = 0; i < numCombs; ++i)
+                    combs[c][i].buffer.assign((size_t) ((combLengths[i] + stereoSpread * c) * sampleRate / 44100.0), 0.0f);
+                for (int i = 0; i < numAllpasses; ++i)
+                    allpasses[c][i].buffer.assign((size_t) ((allpassLengths[i] + stereoSpread * c) * sampleRate / 44100.0), 0.0f);
+            }
+            damping = params.damping * 0.4f;
+            feedback = params.roomSize * 0.28f + 0.7f;
+            const float wet = params.wetLevel * 3.0f;
+            wetSame = 0.5f * wet * (1.0f + params.width);
+            wetCross = 0.5f * wet * (1.0f - params.width);
+            dry = params.dryLevel * 2.0f;
+        }
+
+        void process(float* left, float* right, int numSamples)
+        {
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const float input = (left[i] + right[i]) * 0.015f;
+                float outLeft = 0.0f, outRight = 0.0f;
+                for (int c = 0; c < numCombs; ++c)
+                {
+                    outLeft += combs[0][c].process(input, damping, feedback);
+                    outRight += combs[1][c].process(input, damping, feedback);
+                }
+                for (int a = 0; a < numAllpasses; ++a)
+                {
+                    outLeft = allpasses[0][a].process(outLeft);
+                    outRight = allpasses[1][a].process(outRight);
+                }
+                const float dryLeft = left[i], dryRight = right[i];
+                left[i] = outLeft * wetSame + outRight * wetCross + dryLeft * dry;
+                right[i] = outRight * wetSame + outLeft * wetCross + dryRight * dry;
+            }
+        }
+
+    private:
+        static constexpr int numCombs = 8, numAllpasses = 4;
+
+        struct Comb
+        {
+            std::vector<float> buffer;
+            size_t index = 0;
+            float last = 0.0f;
+
+            float process(float input, float damp, float feedback)
+            {
+                const float output = buffer[index];
+                last = output * (1.0f - damp) + last * damp;
+                buffer[index] = input + last * feedback;
+                if (++index >= buffer.size())
+                    index = 0;
+                return output;
+            }
+        };
+        struct Allpass
+        {
+            std::vector<float> buffer;
+            size_t index = 0;
+
+            float process(float input)
+            {
+                const float delayed = buffer[index];
+                buffer[index] = input + delayed * 0.5f;
+                if (++index >= buffer.size())
+                    index = 0;
+                return delayed - input;
+            }
+        };
+        Comb combs[2][numCombs];
+        Allpass allpasses[2][numAllpasses];
+        float damping = 0.0f, feedback = 0.0f, wetSame = 0.0f, wetCross = 0.0f, dry = 0.0f;
+    };
+
+    // The reverb on its own, on the chain's input, at the plugin's default settings
+    template <typename Reverb>
+    Result benchmarkReverb(const Options& options, const std::string& name, int blockSize, Reverb& reverb)
+    {
+        constexpr int numChannels = 2;
+
+        Result result;
+        result.group = "reverb";
+        result.name = name + "/" + std::to_string(blockSize);
+        result.parameters = {
+            {"reverb", jsonString(name)},
+            {"blockSize", number(blockSize)}
+        };
+        result.audioSecondsPerCall = blockSize / options.sampleRate;
+
+        const int totalSamples = std::max(blockSize, (int) (options.seconds * options.sampleRate));
+        std::vector<std::vector<float>> input(numChannels, std::vector<float>(totalSamples + blockSize));
+        fillInput(input, options.sampleRate);
+
+        for (int start = 0; start < totalSamples; start += blockSize)
+        {
+            const auto startTime = Clock::now();
+            reverb.process(input[0].data() + start, input[1].data() + start, blockSize);
+            const auto endTime = Clock::now();
+            result.callSeconds.push_back(std::chrono::duration<double>(endTime - startTime).count());
+        }
+        return result;
+    }
+
+    //==============================================================================
+    // Mirrors the wet path of ReShimmerAudioProcessor::processBlock(): all the voices from one stretcher,
+    // summed with their gains, through the reverb, and mixed with the dry signal
+    // (decimated runs the wet path at a lower rate, the way the plugin does at 88.2kHz and above)
+    Result benchmarkChain(const Options& options, int activeVoices, int blockSize, ShimmerReverb::Quality quality, int decimation)
+    {
+        constexpr int numChannels = 2, maxVoices = 8;
+        const int pitches[maxVoices] = {12, 0, 7, 19, -12, 24, 5, -5};
+
+        Result result;
+        result.group = "chain";
+        result.name = std::to_string(activeVoices) + "voices/" + (quality == ShimmerReverb::Quality::high ? "high" : "eco") + "/" + std::to_string(blockSize)
+            + (decimation > 1 ? "/decimated" : "");
+        result.parameters = {
+            {"voices", number(activeVoices)},
+            {"reverbQuality", quoted(quality == ShimmerReverb::Quality::high ? "high" : "eco")},
+            {"blockSize", number(blockSize)},
+            {"decimation", number(decimation)}
+        };
+        result.audioSecondsPerCall = blockSize / options.sampleRate;
+
+        const double wetSampleRate = options.sampleRate / decimation;
+        WetDecimator decimator;
+        decimator.prepare(numChannels, decimation, blockSize);
+        const int wetBlockSize = decimator.getMaxLowSamples();
+
+        signalsmith::stretch::SignalsmithStretch<float> stretch;
+        stretch.presetDefault(numChannels, (float) wetSampleRate, maxVoices);
+        stretch.setAmortised(wetBlockSize < stretch.intervalSamples());
+        for (int v = 0; v < maxVoices; ++v)
+        {
+            stretch.setVoiceTransposeSemitones(v, (float) pitches[v], 8000.0f);
+            stretch.setVoiceActive(v, v < activeVoices);
+        }
+
+        ShimmerReverb reverb;
+        reverb.prepare(wetSampleRate);
+        reverb.setQuality(quality);
+        ShimmerReverbParameters reverbParams;
+        reverbParams.wetLevel = 0.5f * (1 - 0.7f * 0.5f);
+        reverbParams.dryLevel = 0.5f;
+        reverb.setParameters(reverbParams);
+
+        const int totalSamples = std::max(blockSize, (int) (options.seconds * options.sampleRate));
+        std::vector<std::vector<float>> input(numChannels, std::vector<float>(totalSamples + blockSize));
+        fillInput(input, options.sampleRate);
+
+        std::vector<std::vector<float>> voiceBuffers(maxVoices * numChannels, std::vector<float>(wetBlockSize));
+        float* voiceChannels[maxVoices][numChannels];
+        float** voiceOutputs[maxVoices];
+        for (int v = 0; v < maxVoices; ++v)
+        {
+            for (int c = 0; c < numChannels; ++c)
+                voiceChannels[v][c] = voiceBuffers[v * numChannels + c].data();
+            voiceOutputs[v] = voiceChannels[v];
+        }
+        std::vector<std::vector<float>> wet(numChannels, std::vector<float>(blockSize));
+        std::vector<float> output(blockSize);
+        float* wetPointers[numChannels] = {wet[0].data(), wet[1].data()};
+        // (without decimation the wet path reads the input and writes the full-rate buffers directly)
+        std::vector<std::vector<float>> lowInput(numChannels, std::vector<float>(wetBlockSize)), lowWet = lowInput;
+        float* lowInputPointers[numChannels] = {lowInput[0].data(), lowInput[1].data()};
+        float* lowWetPointers[numChannels] = {lowWet[0].data(), lowWet[1].data()};
+
+        const float voiceGain = 0.5f, dry = 1.0f, wetGain = 1.0f;
+        const int warmupSamples = (stretch.blockSamples() + stretch.intervalSamples()) * decimation;
+        for (int start = 0; start < totalSamples; start += blockSize)
+        {
+            const float* inputPointers[numChannels] = {input[0].data() + start, input[1].data() + start};
+
+            const auto startTime = Clock::now();
+            int wetSamples = blockSize;
+            const float* const* wetInput = inputPointers;
+            float* const* wetOutput = wetPointers;
+            if (decimation > 1)
+            {
+                wetSamples = decimator.down(inputPointers, blockSize, lowInputPointers);
+                wetInput = lowInputPointers;
+                wetOutput = lowWetPointers;
+            }
+            stretch.processVoices(wetInput, wetSamples, voiceOutputs, wetSamples);
+            for (int c = 0; c < numChannels; ++c)
+            {
+                float* wetChannel = wetOutput[c];
+                std::fill(wetChannel, wetChannel + wetSamples, 0.0f);
+                for (int v = 0; v < activeVoices; ++v)
+                {
+                    const float* voice = voiceChannels[v][c];
+                    for (int i = 0; i < wetSamples; ++i)
+                        wetChannel[i] += voice[i] * voiceGain;
+                }
+            }
+            reverb.process(wetOutput[0], wetOutput[1], wetSamples);
+            if (decimation > 1)
+                decimator.up(lowWetPointers, wetSamples, wetPointers, blockSize);
+            for (int c = 0; c < numChannels; ++c)
+            {
+                const float* in = inputPointers[c];
+                const float* wetChannel = wet[c].data();
+                for (int i = 0; i < blockSize; ++i)
+                    output[i] = in[i] * dry + wetChannel[i] * wetGain;
+            }
+            const auto endTime = Clock::now();
+
+            if (start >= warmupSamples)
+                result.callSeconds.push_back(std::chrono::duration<double>(endTime - startTime).count());
+        }
+        return result;
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool hasValue = i + 1 < argc;
+            if (arg == "--quick")
+                options.quick = true;
+            else if (arg == "--seconds" && hasValue)
+                options.seconds = std::atof(argv[++i]);
+            else if (arg == "--filter" && hasValue)
+                options.filter = argv[++i];
+            else if (arg == "--output" && hasValue)
+                options.outputFile = argv[++i];
+            else if (arg == "--sample-rate" && hasValue)
+                options.sampleRate = std::atof(argv[++i]);
+            else
+            {
+                std::cerr << "usage: " << argv[0] << " [--quick] [--seconds <s>] [--sample-rate <Hz>] [--filter <text>] [--output <file>]\n";
+                return false;
+            }
+        }
+        if (options.quick)
+            options.seconds = std::min(options.seconds, 1.0);
+        return options.seconds > 0 && options.sampleRate > 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (! parseOptions(argc, argv, options))
+        return 1;
+
+    signalsmith::perf::StopDenormals noDenormals;
+
+    std::vector<Result> results;
+    // cases are named before they run, so a filter skips the work as well as the output
+    auto run = [&](const std::string& name, const std::function<Result()>& benchmark) {
+        if (! options.filter.empty() && name.find(options.filter) == std::string::npos)
+            return;
+        std::cerr << name << "\n";
+        results.push_back(benchmark());
+    };
+
+    const std::vector<int> blockSizes = options.quick ? std::vector<int> {32, 256, 4096}
+                                                      : std::vector<int> {32, 64, 128, 256, 512, 1024, 2048, 4096};
+    for (bool cheaper : {false, true})
+        for (int numChannels : {1, 2, 8})
+            for (int semitones : {0, 12, -12})
+                for (int blockSize : blockSizes)
+                {
+                    const std::string name = std::string("stretch/") + (cheaper ? "cheaper" : "default") + "/" + std::to_string(numChannels) + "ch/"
+                        + (semitones > 0 ? "+" : "") + std::to_string(semitones) + "st/" + std::to_string(blockSize);
+                    run(name, [&] { return benchmarkStretch(options, cheaper, numChannels, semitones, blockSize); });
+                }
+
+    for (int size : {64, 256, 1024, 1536, 2048, 4096, 5760, 8192, 16384})
+    {
+        run("fft/" + std::to_string(size), [&] { return benchmarkFft<false>(options, size); });
+        run("realfft/" + std::to_string(size), [&] { return benchmarkFft<true>(options, size); });
+    }
+
+    for (int latency = 0; latency < StretchSettings::numLatencies; ++latency)
+        for (int quality = 0; quality < StretchSettings::numQualities; ++quality)
+            for (int blockSize : {64, 256, 1024})
+            {
+                const std::string name = std::string("settings/") + latencyNames[latency] + "/" + qualityNames[quality] + "/" + std::to_string(blockSize);
+                run(name, [&] { return benchmarkSettings(options, latency, quality, blockSize); });
+                if (blockSize == 64)
+                    run(name + "/unamortised", [&] { return benchmarkSettings(options, latency, quality, blockSize, false); });
+            }
+
+    for (int blockSize : {64, 256, 1024})
+        run("switch/" + std::to_string(blockSize), [&] { return benchmarkSwitching(options, blockSize); });
+
+    ShimmerReverbParameters reverbParams;
+    for (int blockSize : {64, 256, 1024})
+    {
+        run("reverb/freeverb/" + std::to_string(blockSize), [&] {
+            FreeverbReference reverb;
+            reverb.prepare(options.sampleRate, reverbParams);
+            return benchmarkReverb(options, "freeverb", blockSize, reverb);
+        });
+        for (auto quality : {ShimmerReverb::Quality::eco, ShimmerReverb::Quality::high})
+        {
+            const std::string reverbName = quality == ShimmerReverb::Quality::high ? "high" : "eco";
+            run("reverb/" + reverbName + "/" + std::to_string(blockSize), [&] {
+                ShimmerReverb reverb;
+                reverb.prepare(options.sampleRate);
+                reverb.setQuality(quality);
+                reverb.setParameters(reverbParams);
+                return benchmarkReverb(options, reverbName, blockSize, reverb);
+            });
+        }
+    }
+
+    // (at --sample-rate 88200 and above, each chain is run decimated as well)
+    const int decimation = WetDecimator::factorForSampleRate(options.sampleRate);
+    for (int voices : {2, 8})
+        for (auto quality : {ShimmerReverb::Quality::eco, ShimmerReverb::Quality::high})
+            for (int blockSize : {64, 256, 1024})
+            {
+                const std::string name = "chain/" + std::to_string(voices) + "voices/" + (quality == ShimmerReverb::Quality::high ? "high" : "eco") + "/" + std::to_string(blockSize);
+                run(name, [&] { return benchmarkChain(options, voices, blockSize, quality, 1); });
+                if (decimation > 1)
+                    run(name + "/decimated", [&] { return benchmarkChain(options, voices, blockSize, quality, decimation); });
+            }
+
+    if (options.outputFile.empty())
+    {
+        writeJson(std::cout, options, results);
+    }
+    else
+    {
+        std::ofstream file(options.outputFile);
+        writeJson(file, options, results);
+        if (! file)
+        {
+            std::cerr << "couldn't write " << options.outputFile << "\n";
+            return 1;
+        }
+    }
+
+    bool allocated = false;
+    for (auto& result : results)
+    {
+        if (result.allocations > 0)
+        {
+            std::cerr << result.group << "/" << result.name << ": " << result.allocations << " allocations\n";
+            allocated = true;
+        }
+    }
+    return allocated ? 1 : 0;
+}
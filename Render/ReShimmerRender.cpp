@@ -0,0 +1,547 @@
+/*
+  ==============================================================================
+
+    Offline batch renderer: runs WAV/AIFF files through ReShimmerAudioProcessor
+    without a DAW.
+
+        reshimmer-render --state <preset.xml> --output-dir <dir> [options] <files or folders...>
+
+    The state file is the XML the plugin stores (see getStateInformation()).
+    Files are shared out over a work-stealing pool, with one processor per
+    worker.  Each output is trimmed by the plugin's latency and extended by its
+    tail, so it lines up with the input and rings out fully.
+
+    With --chunk, long files are also split into overlapping chunks which render
+    in parallel.  Each chunk is a task of its own, so a single file split into
+    40 chunks keeps 16 workers busy (the summary line reports the number of
+    tasks and workers).  Each chunk warms the processor up on the input before
+    it, and neighbouring chunks are crossfaded.  The result has the same level and
+    spectrum as a straight-through render, but isn't sample-identical: the
+    stretcher's output phases depend on everything it has processed before.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+
+#include "PluginProcessor.h"
+#include "WorkStealingPool.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        juce::File stateFile;
+        juce::File outputDir;
+        juce::Array<juce::File> inputFiles;
+        int blockSize = 8192;
+        int bitDepth = 24;
+        int jobs = 0;
+        // a frozen reverb never decays, so the tail has to stop somewhere
+        double maxTailSeconds = 30.0;
+        // 0 renders each file in one go
+        double chunkSeconds = 0.0;
+        // negative means the whole tail length
+        double warmUpSeconds = -1.0;
+    };
+
+    // how much neighbouring chunks of a split file overlap
+    const double crossfadeSeconds = 0.1;
+
+    const char* const audioFilePatterns = "*.wav;*.aif;*.aiff";
+
+    void printUsage(const char* name)
+    {
+        std::cerr << "usage: " << name << " --state <file> --output-dir <dir> [--jobs <n>] [--block <samples>]"
+                  << " [--bit-depth <16|24|32>] [--max-tail <s>]"
+                  << " [--chunk <s>] [--warm-up <s>] <files or folders...>\n";
+    }
+
+    juce::File getFileArgument(const char* arg)
+    {
+        return juce::File::getCurrentWorkingDirectory().getChildFile(arg);
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool hasValue = i + 1 < argc;
+            if (arg == "--state" && hasValue)
+                options.stateFile = getFileArgument(argv[++i]);
+            else if (arg == "--output-dir" && hasValue)
+                options.outputDir = getFileArgument(argv[++i]);
+            else if (arg == "--jobs" && hasValue)
+                options.jobs = std::atoi(argv[++i]);
+            else if (arg == "--block" && hasValue)
+                options.blockSize = std::atoi(argv[++i]);
+            else if (arg == "--bit-depth" && hasValue)
+                options.bitDepth = std::atoi(argv[++i]);
+            else if (arg == "--max-tail" && hasValue)
+                options.maxTailSeconds = std::atof(argv[++i]);
+            else if (arg == "--chunk" && hasValue)
+                options.chunkSeconds = std::atof(argv[++i]);
+            else if (arg == "--warm-up" && hasValue)
+                options.warmUpSeconds = std::atof(argv[++i]);
+            else if (arg.rfind("--", 0) == 0)
+                return false;
+            else
+            {
+                auto file = getFileArgument(argv[i]);
+                if (file.isDirectory())
+                    options.inputFiles.addArray(file.findChildFiles(juce::File::findFiles, false, audioFilePatterns));
+                else
+                    options.inputFiles.add(file);
+            }
+        }
+        return options.stateFile != juce::File() && options.outputDir != juce::File()
+            && ! options.inputFiles.isEmpty() && options.blockSize > 0 && options.maxTailSeconds >= 0.0;
+    }
+
+    // accepts the plugin's XML as text, or the binary blob getStateInformation() produces
+    bool loadState(const juce::File& file, juce::MemoryBlock& state)
+    {
+        if (auto xml = juce::XmlDocument::parse(file))
+        {
+            juce::AudioProcessor::copyXmlToBinary(*xml, state);
+            return true;
+        }
+        return file.loadFileAsData(state) && state.getSize() > 0;
+    }
+
+    // Everything about one file's render, shared by the tasks working on it
+    struct Render
+    {
+        juce::File inputFile, outputFile;
+        int numChannels = 0;
+        double sampleRate = 0.0;
+        juce::int64 inputLength = 0, outputLength = 0, latency = 0;
+        std::unique_ptr<juce::AudioFormatWriter> writer;
+
+        // a split file has its output cut at these points (the last one is the end), and each chunk is rendered separately
+        std::vector<juce::int64> chunkStarts;
+        juce::int64 warmUp = 0;
+        int crossfade = 0;
+
+        // chunks finish in any order, but are written in order
+        std::mutex writeMutex;
+        std::map<int, juce::AudioBuffer<float>> finishedChunks;
+        int nextChunk = 0;
+        juce::AudioBuffer<float> overlap;
+        int chunksLeft = 0;
+        juce::Result result = juce::Result::ok();
+    };
+
+    // the state goes in before prepareToPlay(), which applies every parameter from scratch
+    void prepareProcessor(ReShimmerAudioProcessor& processor, const juce::MemoryBlock& state,
+                          int numChannels, double sampleRate, int blockSize)
+    {
+        processor.setNonRealtime(true);
+        processor.setPlayConfigDetails(numChannels, numChannels, sampleRate, blockSize);
+        processor.setStateInformation(state.getData(), static_cast<int>(state.getSize()));
+        processor.prepareToPlay(sampleRate, blockSize);
+    }
+
+    // The processor's latency and tail (both depend on the sample-rate and the parameters), and so how long the output is
+    struct RenderLength
+    {
+        juce::int64 latency = 0, outputLength = 0;
+        double tailSeconds = 0.0;
+    };
+
+    RenderLength measureRender(ReShimmerAudioProcessor& processor, const juce::MemoryBlock& state, int numChannels,
+                               double sampleRate, juce::int64 inputLength, const Options& options)
+    {
+        prepareProcessor(processor, state, numChannels, sampleRate, options.blockSize);
+        RenderLength length;
+        length.tailSeconds = processor.getTailLengthSeconds();
+        if (! std::isfinite(length.tailSeconds) || length.tailSeconds > options.maxTailSeconds)
+            length.tailSeconds = options.maxTailSeconds;
+        length.latency = processor.getLatencySamples();
+        length.outputLength = inputLength + static_cast<juce::int64>(std::ceil(length.tailSeconds*sampleRate));
+        processor.releaseResources();
+        return length;
+    }
+
+    int getCrossfadeSamples(double sampleRate)
+    {
+        return juce::roundToInt(crossfadeSeconds*sampleRate);
+    }
+
+    // How many chunks --chunk splits an output into (1 means it renders in one go)
+    juce::int64 getNumChunks(juce::int64 outputLength, double sampleRate, const Options& options)
+    {
+        if (options.chunkSeconds <= 0.0)
+            return 1;
+
+        const juce::int64 chunkSamples = juce::jlimit<juce::int64>(4*getCrossfadeSamples(sampleRate), std::numeric_limits<int>::max()/2,
+                                                                  static_cast<juce::int64>(options.chunkSeconds*sampleRate));
+        return std::max<juce::int64>(1, (outputLength + chunkSamples - 1)/chunkSamples);
+    }
+
+    // Opens the input, works out how long the output is (and where to split it), and opens the output
+    juce::Result openRender(Render& render, std::unique_ptr<juce::AudioFormatReader>& reader,
+                            ReShimmerAudioProcessor& processor, juce::AudioFormatManager& formatManager,
+                            const juce::MemoryBlock& state, const Options& options)
+    {
+        if (render.outputFile == render.inputFile)
+            return juce::Result::fail("the output would overwrite the input");
+
+        reader.reset(formatManager.createReaderFor(render.inputFile));
+        if (reader == nullptr)
+            return juce::Result::fail("can't read " + render.inputFile.getFullPathName());
+
+        render.numChannels = static_cast<int>(reader->numChannels);
+        if (render.numChannels < 1 || render.numChannels > 2)
+            return juce::Result::fail("only mono and stereo files are supported");
+
+        auto* format = formatManager.findFormatForFileExtension(render.outputFile.getFileExtension());
+        if (format == nullptr)
+            return juce::Result::fail("no format for " + render.outputFile.getFileName());
+
+        render.sampleRate = reader->sampleRate;
+        render.inputLength = reader->lengthInSamples;
+
+        const auto length = measureRender(processor, state, render.numChannels, render.sampleRate, render.inputLength, options);
+        render.latency = length.latency;
+        render.outputLength = length.outputLength;
+
+        const juce::int64 numChunks = getNumChunks(render.outputLength, render.sampleRate, options);
+        if (numChunks > 1)
+        {
+            render.crossfade = getCrossfadeSamples(render.sampleRate);
+            // by default the reverb gets its whole tail's worth of input before each chunk
+            // (and it's never less than the latency, or the chunk would start with the stretcher's own pre-roll)
+            const double warmUpSeconds = options.warmUpSeconds >= 0.0 ? options.warmUpSeconds : length.tailSeconds;
+            render.warmUp = std::max(render.latency, static_cast<juce::int64>(std::ceil(warmUpSeconds*render.sampleRate)));
+            for (juce::int64 chunk = 0; chunk <= numChunks; ++chunk)
+                render.chunkStarts.push_back(render.outputLength*chunk/numChunks);
+            render.chunksLeft = static_cast<int>(numChunks);
+        }
+
+        render.outputFile.deleteFile();
+        std::unique_ptr<juce::OutputStream> stream(render.outputFile.createOutputStream());
+        if (stream == nullptr)
+            return juce::Result::fail("can't write " + render.outputFile.getFullPathName());
+
+        render.writer.reset(format->createWriterFor(stream.get(), render.sampleRate,
+                                                    static_cast<unsigned int>(render.numChannels),
+                                                    options.bitDepth, {}, 0));
+        if (render.writer == nullptr)
+            return juce::Result::fail("can't write " + juce::String(options.bitDepth) + "-bit " + render.outputFile.getFileName());
+        // the writer owns the stream now
+        stream.release();
+        return juce::Result::ok();
+    }
+
+    // Runs the input through the processor from `inputStart` (with silence past the end of the input) until the output
+    // reaches `outputEnd`.  Each block of output is passed to `write` with its position in the latency-compensated output.
+    template <typename WriteBlock>
+    bool processRange(ReShimmerAudioProcessor& processor, juce::AudioFormatReader& reader, const Render& render,
+                      juce::int64 inputStart, juce::int64 outputEnd, int blockSize, WriteBlock&& write)
+    {
+        juce::AudioBuffer<float> buffer(render.numChannels, blockSize);
+        juce::MidiBuffer midi;
+        const juce::int64 processEnd = outputEnd + render.latency;
+        for (juce::int64 position = inputStart; position < processEnd; position += blockSize)
+        {
+            const int blockLength = static_cast<int>(std::min<juce::int64>(blockSize, processEnd - position));
+            juce::AudioBuffer<float> block(buffer.getArrayOfWritePointers(), render.numChannels, blockLength);
+
+            block.clear();
+            if (position < render.inputLength)
+            {
+                const int readLength = static_cast<int>(std::min<juce::int64>(blockLength, render.inputLength - position));
+                reader.read(&block, 0, readLength, position, true, true);
+            }
+
+            processor.processBlock(block, midi);
+
+            if (! write(block, position - render.latency))
+                return false;
+        }
+        return true;
+    }
+
+    juce::Result renderWhole(Render& render, juce::AudioFormatReader& reader, ReShimmerAudioProcessor& processor,
+                             const juce::MemoryBlock& state, const Options& options)
+    {
+        prepareProcessor(processor, state, render.numChannels, render.sampleRate, options.blockSize);
+
+        const bool written = processRange(processor, reader, render, 0, render.outputLength, options.blockSize,
+                                          [&] (const juce::AudioBuffer<float>& block, juce::int64 outputPosition)
+        {
+            // the first `latency` samples out are from before the input started
+            const int blockLength = block.getNumSamples();
+            const int skip = static_cast<int>(juce::jlimit<juce::int64>(0, blockLength, -outputPosition));
+            return skip == blockLength || render.writer->writeFromAudioSampleBuffer(block, skip, blockLength - skip);
+        });
+
+        processor.releaseResources();
+        return written ? juce::Result::ok() : juce::Result::fail("write failed for " + render.outputFile.getFullPathName());
+    }
+
+    // How many tasks the files make between them, which is the most workers that can be kept busy: one per file,
+    // or with --chunk one per chunk, so a single long file still spreads over every core.
+    // (This measures each file the same way openRender() will, with a processor of its own.)
+    int countTasks(const Options& options, const juce::MemoryBlock& state)
+    {
+        if (options.chunkSeconds <= 0.0)
+            return options.inputFiles.size();
+
+        ReShimmerAudioProcessor processor;
+        juce::AudioFormatManager formatManager;
+        formatManager.registerBasicFormats();
+
+        juce::int64 numTasks = 0;
+        for (const auto& inputFile : options.inputFiles)
+        {
+            std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(inputFile));
+            // a file which won't render is still one task, which reports the error
+            if (reader == nullptr || reader->numChannels < 1 || reader->numChannels > 2)
+            {
+                ++numTasks;
+                continue;
+            }
+
+            const auto length = measureRender(processor, state, static_cast<int>(reader->numChannels),
+                                              reader->sampleRate, reader->lengthInSamples, options);
+            numTasks += getNumChunks(length.outputLength, reader->sampleRate, options);
+        }
+        return static_cast<int>(std::min<juce::int64>(numTasks, std::numeric_limits<int>::max()));
+    }
+
+    // Renders one chunk of a split file, into `output`.  The stretcher is given seek() pre-roll and the reverb is warmed
+    // up on the input before the chunk, so it starts close to where a straight-through render would be at that point.
+    // Each chunk (apart from the last) runs `crossfade` samples into the next one.
+    juce::Result renderChunk(Render& render, int chunk, ReShimmerAudioProcessor& processor,
+                             juce::AudioFormatManager& formatManager, const juce::MemoryBlock& state,
+                             const Options& options, juce::AudioBuffer<float>& output)
+    {
+        std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(render.inputFile));
+        if (reader == nullptr)
+            return juce::Result::fail("can't read " + render.inputFile.getFullPathName());
+
+        const bool lastChunk = chunk + 2 == static_cast<int>(render.chunkStarts.size());
+        const juce::int64 start = render.chunkStarts[static_cast<size_t>(chunk)];
+        const juce::int64 end = lastChunk ? render.outputLength : render.chunkStarts[static_cast<size_t>(chunk + 1)] + render.crossfade;
+
+        prepareProcessor(processor, state, render.numChannels, render.sampleRate, options.blockSize);
+
+        const juce::int64 inputStart = std::max<juce::int64>(0, start - render.warmUp);
+        if (inputStart > 0)
+        {
+            const int preRollLength = static_cast<int>(std::min<juce::int64>(processor.getSeekSamples(), inputStart));
+            juce::AudioBuffer<float> preRoll(render.numChannels, preRollLength);
+            preRoll.clear();
+            reader->read(&preRoll, 0, preRollLength, inputStart - preRollLength, true, true);
+            processor.seekInput(preRoll);
+        }
+
+        output.setSize(render.numChannels, static_cast<int>(end - start));
+        processRange(processor, *reader, render, inputStart, end, options.blockSize,
+                     [&] (const juce::AudioBuffer<float>& block, juce::int64 outputPosition)
+        {
+            // only keep the part of the block inside this chunk
+            const juce::int64 from = std::max(outputPosition, start);
+            const juce::int64 to = std::min(outputPosition + block.getNumSamples(), end);
+            for (int channel = 0; from < to && channel < render.numChannels; ++channel)
+                output.copyFrom(channel, static_cast<int>(from - start), block, channel,
+                                static_cast<int>(from - outputPosition), static_cast<int>(to - from));
+            return true;
+        });
+
+        processor.releaseResources();
+        return juce::Result::ok();
+    }
+
+    // Fades from the end of one chunk into the start of the next, in place.
+    // The dry signal is identical in both renders, but the stretcher's phases drift apart after a restart, so the wet
+    // signal isn't.  The fade is equal-power, corrected by how correlated the two are, so the level stays steady either way.
+    void crossfade(const juce::AudioBuffer<float>& previous, juce::AudioBuffer<float>& next)
+    {
+        const int fadeLength = previous.getNumSamples();
+        for (int channel = 0; channel < next.getNumChannels(); ++channel)
+        {
+            const float* from = previous.getReadPointer(channel);
+            float* to = next.getWritePointer(channel);
+
+            double fromTo = 0.0, fromEnergy = 0.0, toEnergy = 0.0;
+            for (int i = 0; i < fadeLength; ++i)
+            {
+                fromTo += from[i]*to[i];
+                fromEnergy += from[i]*from[i];
+                toEnergy += to[i]*to[i];
+            }
+            const float correlation = (fromEnergy > 0.0 && toEnergy > 0.0)
+                ? static_cast<float>(juce::jmax(0.0, fromTo/std::sqrt(fromEnergy*toEnergy))) : 0.0f;
+
+            for (int i = 0; i < fadeLength; ++i)
+            {
+                const float phase = juce::MathConstants<float>::halfPi*(i + 0.5f)/fadeLength;
+                const float fadeIn = std::sin(phase), fadeOut = std::cos(phase);
+                const float normalise = 1.0f/std::sqrt(1.0f + 2.0f*correlation*fadeIn*fadeOut);
+                to[i] = (from[i]*fadeOut + to[i]*fadeIn)*normalise;
+            }
+        }
+    }
+
+    // Writes out every chunk which is ready (this one, and any later ones it was holding up), crossfading
+    // each one with the end of the one before.  Returns true once the last chunk of the file has been dealt with.
+    bool finishChunk(Render& render, int chunk, juce::AudioBuffer<float>&& output, const juce::Result& result)
+    {
+        std::lock_guard<std::mutex> lock(render.writeMutex);
+        if (result.failed() && render.result.wasOk())
+            render.result = result;
+
+        if (render.result.wasOk())
+        {
+            render.finishedChunks[chunk] = std::move(output);
+            for (auto next = render.finishedChunks.find(render.nextChunk); next != render.finishedChunks.end();
+                 next = render.finishedChunks.find(render.nextChunk))
+            {
+                auto& buffer = next->second;
+                if (render.nextChunk > 0)
+                    crossfade(render.overlap, buffer);
+
+                const size_t index = static_cast<size_t>(render.nextChunk);
+                const int length = static_cast<int>(render.chunkStarts[index + 1] - render.chunkStarts[index]);
+                if (! render.writer->writeFromAudioSampleBuffer(buffer, 0, length))
+                {
+                    render.result = juce::Result::fail("write failed for " + render.outputFile.getFullPathName());
+                    break;
+                }
+
+                const int overlapLength = buffer.getNumSamples() - length;
+                render.overlap.setSize(render.numChannels, overlapLength);
+                for (int channel = 0; channel < render.numChannels; ++channel)
+                    render.overlap.copyFrom(channel, 0, buffer, channel, length, overlapLength);
+
+                render.finishedChunks.erase(next);
+                ++render.nextChunk;
+            }
+        }
+
+        if (--render.chunksLeft > 0)
+            return false;
+
+        render.finishedChunks.clear();
+        render.writer.reset();
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (! parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // the parameter tree expects a message manager to exist, even though nothing here runs one
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::MemoryBlock state;
+    if (! loadState(options.stateFile, state))
+    {
+        std::cerr << "can't load the state from " << options.stateFile.getFullPathName() << "\n";
+        return 1;
+    }
+
+    if (! options.outputDir.createDirectory())
+    {
+        std::cerr << "can't create " << options.outputDir.getFullPathName() << "\n";
+        return 1;
+    }
+
+    // workers beyond the number of tasks would only sit idle
+    const int numTasks = countTasks(options, state);
+    int jobs = options.jobs > 0 ? options.jobs : juce::SystemStats::getNumCpus();
+    jobs = juce::jlimit(1, juce::jmax(1, numTasks), jobs);
+
+    // one processor (and format manager) per worker, all made here on the message thread
+    std::vector<std::unique_ptr<ReShimmerAudioProcessor>> processors;
+    std::vector<std::unique_ptr<juce::AudioFormatManager>> formatManagers;
+    for (int worker = 0; worker < jobs; ++worker)
+    {
+        processors.push_back(std::make_unique<ReShimmerAudioProcessor>());
+        formatManagers.push_back(std::make_unique<juce::AudioFormatManager>());
+        formatManagers.back()->registerBasicFormats();
+    }
+
+    WorkStealingPool pool(jobs);
+    std::mutex printMutex;
+    std::atomic<int> failures { 0 };
+
+    auto report = [&] (const Render& render, const juce::Result& result)
+    {
+        std::lock_guard<std::mutex> lock(printMutex);
+        if (result.wasOk())
+        {
+            std::cout << render.inputFile.getFileName() << " -> " << render.outputFile.getFullPathName() << "\n";
+        }
+        else
+        {
+            std::cerr << render.inputFile.getFileName() << ": " << result.getErrorMessage() << "\n";
+            ++failures;
+        }
+    };
+
+    for (const auto& inputFile : options.inputFiles)
+    {
+        auto render = std::make_shared<Render>();
+        render->inputFile = inputFile;
+        render->outputFile = options.outputDir.getChildFile(inputFile.getFileName());
+
+        pool.add([&, render] (int worker)
+        {
+            auto& processor = *processors[static_cast<size_t>(worker)];
+            auto& formatManager = *formatManagers[static_cast<size_t>(worker)];
+
+            std::unique_ptr<juce::AudioFormatReader> reader;
+            auto result = openRender(*render, reader, processor, formatManager, state, options);
+            if (result.failed() || render->chunkStarts.empty())
+            {
+                if (result.wasOk())
+                    result = renderWhole(*render, *reader, processor, state, options);
+                render->writer.reset();
+                report(*render, result);
+                return;
+            }
+
+            // the chunks go on this worker's queue, in order, so other workers steal the earliest ones first
+            for (int chunk = 0; chunk + 1 < static_cast<int>(render->chunkStarts.size()); ++chunk)
+            {
+                pool.add([&, render, chunk] (int chunkWorker)
+                {
+                    juce::AudioBuffer<float> output;
+                    auto chunkResult = renderChunk(*render, chunk, *processors[static_cast<size_t>(chunkWorker)],
+                                                   *formatManagers[static_cast<size_t>(chunkWorker)], state, options, output);
+                    if (finishChunk(*render, chunk, std::move(output), chunkResult))
+                        report(*render, render->result);
+                }, worker);
+            }
+        });
+    }
+
+    const auto startTime = juce::Time::getMillisecondCounterHiRes();
+    pool.run();
+    const auto seconds = (juce::Time::getMillisecondCounterHiRes() - startTime)*0.001;
+
+    std::cout << options.inputFiles.size() - failures.load() << " of " << options.inputFiles.size()
+              << " files rendered in " << seconds << "s (" << numTasks << " tasks on " << jobs << " workers)\n";
+    return failures.load() > 0 ? 1 : 0;
+}
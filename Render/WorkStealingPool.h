@@ -0,0 +1,127 @@
+/*
+  ==============================================================================
+
+    A small work-stealing thread pool for offline rendering.
+
+    Each worker has its own task queue: it works from the back of its own
+    queue, and when that's empty it steals from the front of another worker's.
+    Tasks are told which worker is running them, so per-worker state (like a
+    processor instance) can be indexed without any locking.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool
+{
+public:
+    using Task = std::function<void (int worker)>;
+
+    explicit WorkStealingPool(int numWorkers)
+        : queues(static_cast<size_t>(std::max(numWorkers, 1)))
+    {
+        for (auto& queue : queues)
+            queue = std::make_unique<Queue>();
+    }
+
+    int getNumWorkers() const
+    {
+        return static_cast<int>(queues.size());
+    }
+
+    /// Adds a task to a worker's queue.  Tasks can also add more tasks while the pool is running.
+    void add(Task task, int worker = -1)
+    {
+        if (worker < 0 || worker >= getNumWorkers())
+            worker = static_cast<int>(nextQueue++ % queues.size());
+
+        pending.fetch_add(1);
+        auto& queue = *queues[static_cast<size_t>(worker)];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    /// Runs every task (including any added along the way) and returns when they've all finished.
+    void run()
+    {
+        std::vector<std::thread> threads;
+        for (int worker = 1; worker < getNumWorkers(); ++worker)
+            threads.emplace_back([this, worker] { workerLoop(worker); });
+
+        // the calling thread is worker 0
+        workerLoop(0);
+
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::atomic<size_t> nextQueue { 0 };
+
+    // tasks which have been added but haven't finished yet
+    std::atomic<int> pending { 0 };
+
+    bool popOwn(int worker, Task& task)
+    {
+        auto& queue = *queues[static_cast<size_t>(worker)];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            return false;
+
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(int worker, Task& task)
+    {
+        const int numWorkers = getNumWorkers();
+        for (int offset = 1; offset < numWorkers; ++offset)
+        {
+            auto& queue = *queues[static_cast<size_t>((worker + offset) % numWorkers)];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty())
+                continue;
+
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    void workerLoop(int worker)
+    {
+        Task task;
+        while (pending.load() > 0)
+        {
+            if (popOwn(worker, task) || steal(worker, task))
+            {
+                task(worker);
+                task = nullptr;
+                pending.fetch_sub(1);
+            }
+            else
+            {
+                // everything left is already running somewhere, but it might add more
+                std::this_thread::yield();
+            }
+        }
+    }
+};
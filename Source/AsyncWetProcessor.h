@@ -0,0 +1,181 @@
+/*
+  ==============================================================================
+
+    Runs the wet path on a background real-time thread, in fixed-size chunks,
+    so its cost doesn't depend on the host's block size.
+
+    The audio thread only copies: it pushes its input into one lock-free ring
+    and pulls the finished wet signal out of another.  The output ring starts
+    off holding some silence, which is the extra latency this costs: one chunk
+    (waiting for a chunk's worth of input), plus whichever is longer of a
+    chunk or a host block, which is how long the background thread has to
+    process each chunk.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+
+class AsyncWetProcessor
+{
+public:
+    // processes one chunk in place: the input is replaced by the wet output
+    using ChunkCallback = std::function<void (juce::AudioBuffer<float>& chunk)>;
+
+    ~AsyncWetProcessor()
+    {
+        stop();
+    }
+
+    // (Re)starts the background thread.  This isn't real-time safe, so call it from prepareToPlay().
+    void start(int numChannels, int chunkSamples, int maxBlockSamples, double sampleRate, ChunkCallback callback)
+    {
+        stop();
+        processChunk = std::move(callback);
+        chunkSize = chunkSamples;
+        latency = chunkSamples + std::max(chunkSamples, maxBlockSamples);
+
+        // room for everything in flight, plus a few spare chunks in case the thread gets held up
+        const int ringSize = 2 * latency + 2 * chunkSamples + 1;
+        inputFifo.setTotalSize(ringSize);
+        outputFifo.setTotalSize(ringSize);
+        inputRing.setSize(numChannels, ringSize);
+        outputRing.setSize(numChannels, ringSize);
+        chunkBuffer.setSize(numChannels, chunkSamples);
+        inputFifo.reset();
+        outputFifo.reset();
+
+        // the silence that the output is delayed by
+        outputRing.clear();
+        outputFifo.finishedWrite(latency);
+        missingSamples = 0;
+
+        worker = std::make_unique<Worker>(*this);
+        const auto options = juce::Thread::RealtimeOptions{}.withApproximateAudioProcessingTime(chunkSamples, sampleRate);
+        if (! worker->startRealtimeThread(options))
+            worker->startThread(juce::Thread::Priority::highest);
+    }
+
+    void stop()
+    {
+        if (worker != nullptr)
+            worker->stopThread(1000);
+        worker.reset();
+    }
+
+    bool isRunning() const
+    {
+        return worker != nullptr;
+    }
+
+    int getLatencySamples() const
+    {
+        return latency;
+    }
+
+    // Audio thread: hands over a block of input, and fills `output` with the same number of samples of wet signal
+    void process(const juce::AudioBuffer<float>& input, juce::AudioBuffer<float>& output, int numSamples)
+    {
+        // if the thread has fallen far enough behind to fill the ring, the newest input is dropped
+        const int toWrite = std::min(numSamples, inputFifo.getFreeSpace());
+        copyIntoRing(inputFifo, inputRing, input, toWrite);
+
+        // output which should have been played already is skipped, so the wet signal doesn't drift later
+        if (missingSamples > 0)
+        {
+            const int skipped = std::min(missingSamples, outputFifo.getNumReady());
+            outputFifo.finishedRead(skipped);
+            missingSamples -= skipped;
+        }
+
+        // an underrun (the thread didn't finish in time) comes out as silence
+        const int toRead = std::min(numSamples, outputFifo.getNumReady());
+        copyFromRing(outputFifo, outputRing, output, toRead);
+        if (toRead < numSamples)
+        {
+            output.clear(toRead, numSamples - toRead);
+            missingSamples += numSamples - toRead;
+        }
+    }
+
+private:
+    ChunkCallback processChunk;
+    int chunkSize = 0, latency = 0;
+
+    // single producer, single consumer: the audio thread writes the input and reads the output, the worker the reverse
+    juce::AbstractFifo inputFifo { 1 }, outputFifo { 1 };
+    juce::AudioBuffer<float> inputRing, outputRing, chunkBuffer;
+
+    // (only touched by the audio thread)
+    int missingSamples = 0;
+
+    static void copyIntoRing(juce::AbstractFifo& fifo, juce::AudioBuffer<float>& ring, const juce::AudioBuffer<float>& source, int numSamples)
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+        for (int channel = 0; channel < ring.getNumChannels(); ++channel)
+        {
+            if (size1 > 0)
+                ring.copyFrom(channel, start1, source, channel, 0, size1);
+            if (size2 > 0)
+                ring.copyFrom(channel, start2, source, channel, size1, size2);
+        }
+        fifo.finishedWrite(size1 + size2);
+    }
+
+    static void copyFromRing(juce::AbstractFifo& fifo, const juce::AudioBuffer<float>& ring, juce::AudioBuffer<float>& destination, int numSamples)
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(numSamples, start1, size1, start2, size2);
+        for (int channel = 0; channel < ring.getNumChannels(); ++channel)
+        {
+            if (size1 > 0)
+                destination.copyFrom(channel, 0, ring, channel, start1, size1);
+            if (size2 > 0)
+                destination.copyFrom(channel, size1, ring, channel, start2, size2);
+        }
+        fifo.finishedRead(size1 + size2);
+    }
+
+    // Processes every whole chunk of input that's waiting, and returns whether there were any
+    bool processWaitingChunks()
+    {
+        bool processedAny = false;
+        while (inputFifo.getNumReady() >= chunkSize && outputFifo.getFreeSpace() >= chunkSize)
+        {
+            copyFromRing(inputFifo, inputRing, chunkBuffer, chunkSize);
+            processChunk(chunkBuffer);
+            copyIntoRing(outputFifo, outputRing, chunkBuffer, chunkSize);
+            processedAny = true;
+        }
+        return processedAny;
+    }
+
+    // The audio thread never signals the worker (that would mean taking a lock), so the worker naps between checks.
+    // Each chunk has at least a chunk's worth of time to be processed in, so a 1ms nap doesn't make it late.
+    struct Worker : juce::Thread
+    {
+        explicit Worker(AsyncWetProcessor& owner)
+            : juce::Thread("ReShimmer wet path"), processor(owner)
+        {
+        }
+
+        void run() override
+        {
+            while (! threadShouldExit())
+            {
+                if (! processor.processWaitingChunks())
+                    sleep(1);
+            }
+        }
+
+        AsyncWetProcessor& processor;
+    };
+    std::unique_ptr<Worker> worker;
+};
@@ -9,6 +9,75 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
+namespace
+{
+    const char* const pitchParamIDs[] = { "PITCH1", "PITCH2", "PITCH3", "PITCH4", "PITCH5", "PITCH6", "PITCH7", "PITCH8" };
+    const char* const gainParamIDs[] = { "GAIN1", "GAIN2", "GAIN3", "GAIN4", "GAIN5", "GAIN6", "GAIN7", "GAIN8" };
+
+    // sessions saved before the voice bank had one balance between two voices, instead of a gain for each voice
+    void migratePitchBalance (juce::ValueTree& state)
+    {
+        const auto balance = state.getChildWithProperty ("id", "PBALANCE");
+        if (! balance.isValid() || state.getChildWithProperty ("id", gainParamIDs[0]).isValid())
+            return;
+
+        const float pBalance = balance.getProperty ("value");
+        auto addParameter = [&state] (const char* id, float value)
+        {
+            juce::ValueTree parameter ("PARAM");
+            parameter.setProperty ("id", id, nullptr);
+            parameter.setProperty ("value", value, nullptr);
+            state.appendChild (parameter, nullptr);
+        };
+        addParameter (gainParamIDs[0], 1.0f - pBalance);
+        addParameter (gainParamIDs[1], pBalance);
+        state.removeChild (balance, nullptr);
+    }
+
+    const int tonalityLimit = 8000;
+    const double mixSmoothingSeconds = 0.05;
+
+    // below this level (-100dB) the input and the wet signal count as silent
+    const float idleThreshold = 1.0e-5f;
+
+    // how long the reverb takes to decay below the idle threshold
+    // (the decay is exponential, so scale its -60dB time up to the threshold's level)
+    double reverbTailSeconds(float roomSize)
+    {
+        return ShimmerReverb::decaySeconds(roomSize) * std::log(idleThreshold) / std::log(0.001);
+    }
+
+    // Sums the voices into the output in one pass, ramping each voice's gain linearly.
+    // The voice count is fixed at compile-time, so the inner loop unrolls and the sample loop vectorises.
+    template <int numVoices>
+    void mixVoices(float* output, const float* const* voices, const float* startGains, const float* gainSteps, int numSamples)
+    {
+        for (int sample = 0; sample < numSamples; ++sample)
+        {
+            float sum = 0.0f;
+            for (int v = 0; v < numVoices; ++v)
+                sum += voices[v][sample] * (startGains[v] + gainSteps[v] * (float) sample);
+            output[sample] = sum;
+        }
+    }
+
+    void mixVoices(int numVoices, float* output, const float* const* voices, const float* startGains, const float* gainSteps, int numSamples)
+    {
+        switch (numVoices)
+        {
+            case 0: juce::FloatVectorOperations::clear(output, numSamples); break;
+            case 1: mixVoices<1>(output, voices, startGains, gainSteps, numSamples); break;
+            case 2: mixVoices<2>(output, voices, startGains, gainSteps, numSamples); break;
+            case 3: mixVoices<3>(output, voices, startGains, gainSteps, numSamples); break;
+            case 4: mixVoices<4>(output, voices, startGains, gainSteps, numSamples); break;
+            case 5: mixVoices<5>(output, voices, startGains, gainSteps, numSamples); break;
+            case 6: mixVoices<6>(output, voices, startGains, gainSteps, numSamples); break;
+            case 7: mixVoices<7>(output, voices, startGains, gainSteps, numSamples); break;
+            default: mixVoices<8>(output, voices, startGains, gainSteps, numSamples); break;
+        }
+    }
+}
+
 //==============================================================================
 ReShimmerAudioProcessor::ReShimmerAudioProcessor()
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -22,10 +91,34 @@ ReShimmerAudioProcessor::ReShimmerAudioProcessor()
                        )
 #endif
 {
+    parameterPointers.bypass = apvts.getRawParameterValue("Bypass");
+    parameterPointers.dry = apvts.getRawParameterValue("DRY");
+    parameterPointers.wet = apvts.getRawParameterValue("WET");
+    for (int v = 0; v < maxPitchVoices; ++v)
+    {
+        parameterPointers.pitch[v] = apvts.getRawParameterValue(pitchParamIDs[v]);
+        parameterPointers.gain[v] = apvts.getRawParameterValue(gainParamIDs[v]);
+    }
+    parameterPointers.roomSize = apvts.getRawParameterValue("ROOMSIZE");
+    parameterPointers.damping = apvts.getRawParameterValue("DAMPING");
+    parameterPointers.reverbMix = apvts.getRawParameterValue("REVERBMIX");
+    parameterPointers.width = apvts.getRawParameterValue("WIDTH");
+    parameterPointers.freeze = apvts.getRawParameterValue("FREEZE");
+    parameterPointers.reverbQuality = apvts.getRawParameterValue("REVERBQUALITY");
+    parameterPointers.stretchQuality = apvts.getRawParameterValue("STRETCHQUALITY");
+    parameterPointers.latency = apvts.getRawParameterValue("LATENCY");
+    parameterPointers.parallelVoices = apvts.getRawParameterValue("PARALLELVOICES");
+    parameterPointers.asyncMode = apvts.getRawParameterValue("ASYNCMODE");
+    parameterPointers.decimatedWet = apvts.getRawParameterValue("DECIMATEDWET");
+    
+    stretch.setVoiceRunner([this] (const VoiceWorkerPool::VoiceJobs& jobs) { voiceWorkers.run(jobs); });
 }
 
 ReShimmerAudioProcessor::~ReShimmerAudioProcessor()
 {
+    // the wet path's thread uses the members, so it has to stop before they're destroyed
+    asyncWet.stop();
+    cancelPendingUpdate();
 }
 
 //==============================================================================
@@ -63,7 +156,15 @@ bool ReShimmerAudioProcessor::isMidiEffect() const
 
 double ReShimmerAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    // a frozen reverb never decays
+    if (parameterPointers.freeze->load() >= 0.5f)
+        return std::numeric_limits<double>::infinity();
+    
+    double stretchSeconds = 0.0;
+    if (getSampleRate() > 0.0)
+        stretchSeconds = getWetLatencySamples() / getSampleRate();
+    
+    return stretchSeconds + reverbTailSeconds(parameterPointers.roomSize->load());
 }
 
 int ReShimmerAudioProcessor::getNumPrograms()
@@ -98,47 +199,90 @@ juce::AudioProcessorParameter* ReShimmerAudioProcessor::getBypassParameter() con
 //==============================================================================
 void ReShimmerAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    const int numInputChannels = getTotalNumInputChannels();
     const int numOutputChannels = getTotalNumOutputChannels();
     
+    // the wet path's thread has to be stopped before anything it uses is touched
+    asyncWet.stop();
+    // (an offline render runs faster than real-time, so the thread could never keep up)
+    asyncMode = parameterPointers.asyncMode->load() >= 0.5f && ! isNonRealtime();
+    
     // previousDelayMS = apvts.getRawParameterValue("TIME")->load();
+    
+    // everything is applied from scratch here, so there's nothing to compare against
+    currentParams = loadParameters();
+    
+    // the stretcher and the reverb run at the wet path's rate, and everything else at the full rate
+    // (like async mode, this only changes the next time playback is prepared)
+    const int decimation = parameterPointers.decimatedWet->load() >= 0.5f ? WetDecimator::factorForSampleRate(sampleRate) : 1;
+    wetSampleRate = sampleRate / decimation;
+    decimator.prepare(getTotalNumInputChannels(), decimation, samplesPerBlock);
+    hostLowBlockSamples = decimator.getMaxLowSamples();
        
-    for (int i=0; i<numPitchBuffer; ++i)
+    // every latency and quality is allocated for now, so they can be switched on the audio thread
+    // (all of them before any is configured, since configuring resizes whatever has nothing reserved in place)
+    configureStretch(currentParams, wetSampleRate);
+    StretchSettings::reserveAll(stretch, getTotalNumInputChannels(), wetSampleRate);
+    int maxStretchLatency = 0;
+    for (int latency = 0; latency < StretchSettings::numLatencies; ++latency)
+    {
+        for (int quality = 0; quality < StretchSettings::numQualities; ++quality)
+        {
+            auto settingParams = currentParams;
+            settingParams.latency = latency;
+            settingParams.stretchQuality = quality;
+            configureStretch(settingParams, wetSampleRate);
+            maxStretchLatency = juce::jmax(maxStretchLatency, stretchLatencySamples.load(std::memory_order_relaxed));
+        }
+    }
+    configureStretch(currentParams, wetSampleRate);
+    stretch.reset();
+    
+    // async mode processes the wet path in interval-sized chunks, so the buffers have to hold one of those
+    const int asyncChunkSamples = stretch.intervalSamples() * decimation;
+    const int wetBlockSamples = asyncMode ? juce::jmax(samplesPerBlock, asyncChunkSamples) : samplesPerBlock;
+    if (wetBlockSamples != samplesPerBlock)
+        decimator.prepare(getTotalNumInputChannels(), decimation, wetBlockSamples);
+    const int lowBlockSamples = decimator.getMaxLowSamples();
+    
+    // the worker threads are only started while parallel voices are switched on
+    voiceWorkers.setEnabled(currentParams.parallelVoices);
+    voiceWorkers.prepare(juce::SystemStats::getNumCpus() - 1, sampleRate, samplesPerBlock);
+    
+    for (int i=0; i<maxPitchVoices; ++i)
     {
-        stretch[i].presetDefault(2, sampleRate);
-        mPitchBuffer[i].setSize(numOutputChannels, samplesPerBlock);
+        mPitchBuffer[i].setSize(numOutputChannels, lowBlockSamples);
+        
+        // voices without any gain are switched off until they're needed
+        voiceGains[i] = currentParams.gain[i];
+        stretch.setVoiceActive(i, voiceGains[i] > 0.0f);
         
-        stretch[i].reset();
+        stretch.setVoiceTransposeSemitones(i, currentParams.pitch[i], tonalityLimit);
     }
     
     
     // setup the preMixBuffer
-    preMixBuffer.setSize(numOutputChannels, samplesPerBlock);
+    preMixBuffer.setSize(numOutputChannels, wetBlockSamples);
+    // (only needed when there's a lower rate to hold)
+    decimatedInput.setSize(numOutputChannels, decimation > 1 ? lowBlockSamples : 0);
+    decimatedWetBuffer.setSize(numOutputChannels, decimation > 1 ? lowBlockSamples : 0);
+    
+    masterDry.reset(sampleRate, mixSmoothingSeconds);
+    masterDry.setCurrentAndTargetValue(currentParams.dry);
+    masterWet.reset(sampleRate, mixSmoothingSeconds);
+    masterWet.setCurrentAndTargetValue(currentParams.wet);
+    mixGainBuffer.setSize(2, samplesPerBlock);
     
     //DBG(sampleRate);
     //DBG(samplesPerBlock);
     
-    int outputLatency = stretch[0].outputLatency();
-    setLatencySamples(outputLatency);
-    
-
-    const int pitch1 = apvts.getRawParameterValue("PITCH1")->load();
-    const int pitch2 = apvts.getRawParameterValue("PITCH2")->load();
-    const int tonalityLimit = 8000;
-    stretch[0].setTransposeSemitones(pitch1, tonalityLimit);
-    stretch[1].setTransposeSemitones(pitch2, tonalityLimit);
+    asyncWetBuffer.setSize(numOutputChannels, asyncMode ? samplesPerBlock : 0);
     
     // tests
     tempBuffer.setSize(numOutputChannels, samplesPerBlock);
     
     
-    auto processSpec = juce::dsp::ProcessSpec();
-        
-    processSpec.sampleRate = sampleRate;
-    processSpec.maximumBlockSize = samplesPerBlock;
-    processSpec.numChannels = numInputChannels;
-    
-    reverb.prepare(processSpec);
+    reverb.prepare(wetSampleRate);
+    reverb.setQuality(currentParams.reverbQuality == 0 ? ShimmerReverb::Quality::eco : ShimmerReverb::Quality::high);
         
 
     
@@ -150,15 +294,76 @@ void ReShimmerAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBl
     //reverbParams.freezeMode = 0.0f;
     //reverb.setParameters(reverbParams);
     
-    updateReverbParams();
+    updateReverbParams(currentParams);
+    
+    wetIdle = false;
+    silentInputSamples = 0;
+    
+    // start this last, since everything above has to be set up before the thread's first chunk
+    if (asyncMode)
+    {
+        asyncWet.start(getTotalNumInputChannels(), asyncChunkSamples, samplesPerBlock, sampleRate, [this] (juce::AudioBuffer<float>& chunk)
+        {
+            juce::ScopedNoDenormals noDenormals;
+            processWet(chunk, loadParameters());
+            for (int channel = 0; channel < chunk.getNumChannels(); ++channel)
+                chunk.copyFrom(channel, 0, preMixBuffer, channel, 0, chunk.getNumSamples());
+        });
+    }
     
-    reverb.setEnabled(true);
+    // the dry signal is delayed to line up with the wet one, so the whole plugin has exactly the latency it reports
+    const int maxLatency = maxStretchLatency + decimator.getLatencySamples() + (asyncMode ? asyncWet.getLatencySamples() : 0);
+    dryDelay.resize(getTotalNumInputChannels(), maxLatency + samplesPerBlock + 1);
+    dryDelaySamples = getWetLatencySamples();
+    reportedLatency.store(dryDelaySamples);
+    setLatencySamples(dryDelaySamples);
+}
+
+void ReShimmerAudioProcessor::seekInput(const juce::AudioBuffer<float>& preRoll)
+{
+    const int factor = decimator.getFactor();
+    if (factor == 1)
+    {
+        stretch.seek(preRoll.getArrayOfReadPointers(), preRoll.getNumSamples(), 1.0);
+    }
+    else
+    {
+        // the pre-roll goes through the decimator as well, which warms its filters up too
+        // (samples which don't make up a whole low-rate sample are dropped from the start, so none are left waiting)
+        const int numChannels = getTotalNumInputChannels();
+        const int skipped = preRoll.getNumSamples() % factor;
+        const int chunkSamples = decimator.getMaxBlockSamples() / factor * factor;
+        juce::AudioBuffer<float> lowPreRoll(numChannels, preRoll.getNumSamples() / factor);
+        
+        std::vector<const float*> chunkInput(numChannels);
+        std::vector<float*> chunkOutput(numChannels);
+        int lowSamples = 0;
+        for (int start = skipped; start < preRoll.getNumSamples(); start += chunkSamples)
+        {
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                chunkInput[channel] = preRoll.getReadPointer(channel, start);
+                chunkOutput[channel] = lowPreRoll.getWritePointer(channel, lowSamples);
+            }
+            lowSamples += decimator.down(chunkInput.data(), juce::jmin(chunkSamples, preRoll.getNumSamples() - start), chunkOutput.data());
+        }
+        stretch.seek(lowPreRoll.getArrayOfReadPointers(), lowSamples, 1.0);
+    }
+    silentInputSamples = 0;
+}
+
+int ReShimmerAudioProcessor::getSeekSamples() const
+{
+    // the stretcher only looks at the last block (plus one interval) of the pre-roll
+    return (stretch.blockSamples() + stretch.intervalSamples()) * decimator.getFactor();
 }
 
 void ReShimmerAudioProcessor::releaseResources()
 {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
+    asyncWet.stop();
+    voiceWorkers.stop();
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -204,16 +409,23 @@ void ReShimmerAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, ju
         buffer.clear(i, 0, buffer.getNumSamples());
         //mPitchBuffer.clear(i, 0, buffer.getNumSamples());
         
-        mPitchBuffer[0].clear(i, 0, buffer.getNumSamples());
-        mPitchBuffer[1].clear(i, 0, buffer.getNumSamples());
+        // (in async mode these belong to the wet path's thread)
+        if (asyncMode)
+        {
+            asyncWetBuffer.clear(i, 0, buffer.getNumSamples());
+            continue;
+        }
+        
+        for (int v = 0; v < maxPitchVoices; ++v)
+            mPitchBuffer[v].clear(i, 0, buffer.getNumSamples());
         
         preMixBuffer.clear(i, 0, buffer.getNumSamples());
     }
     
     
-    bool bypassed = apvts.getRawParameterValue("Bypass")->load();
+    const ParameterSnapshot params = loadParameters();
     
-    if (! bypassed)
+    if (! params.bypassed)
     {
         
         // float **inputBuffers, **outputBuffers;
@@ -236,104 +448,313 @@ void ReShimmerAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, ju
                 
     
         //DBG(bufferLength);
-        auto inputBuffers = buffer.getArrayOfReadPointers();
         //auto inputBuffers = tempBuffer.getArrayOfReadPointers();
 
         
         // calculate all pitchbuffer
-        //for (int pitch=0; pitch<numPitchBuffer; ++pitch)
+        //for (int pitch=0; pitch<maxPitchVoices; ++pitch)
         //{
         //    auto pitchOutBuffers = mPitchBuffer[pitch].getArrayOfWritePointers();
         //    stretch[pitch].process(inputBuffers, bufferLength, pitchOutBuffers, bufferLength);
         //}
         
         
-        //DBG(inputBuffers[0][10]);
-        auto pitchOutBuffers = mPitchBuffer[0].getArrayOfWritePointers();
-        stretch[0].process(inputBuffers, bufferLength, pitchOutBuffers, bufferLength);
-        
-        //DBG(inputBuffers[0][10]);
-        //auto inputBuffers2 = buffer.getArrayOfReadPointers();
-        auto pitchOutBuffers2 = mPitchBuffer[1].getArrayOfWritePointers();
-        stretch[1].process(inputBuffers, bufferLength, pitchOutBuffers2, bufferLength);
-        
-        
         // Mixing variables
-        const float masterDry = apvts.getRawParameterValue("DRY")->load();
-        const float masterWet = apvts.getRawParameterValue("WET")->load();
+        masterDry.setTargetValue(params.dry);
+        masterWet.setTargetValue(params.wet);
         
-        const float pBalance = apvts.getRawParameterValue("PBALANCE")->load();
+        juce::AudioBuffer<float> input(buffer.getArrayOfWritePointers(), totalNumInputChannels, bufferLength);
+        if (asyncMode)
+        {
+            // the wet path runs on its own thread, so all that happens here is handing over the input and collecting the output
+            asyncWet.process(input, asyncWetBuffer, bufferLength);
+        }
+        else
+        {
+            processWet(input, params);
+        }
+        const juce::AudioBuffer<float>& wetBuffer = asyncMode ? asyncWetBuffer : preMixBuffer;
         
+        // the wet path has had the input, so the dry signal can be delayed in place
+        delayDry(buffer, totalNumInputChannels, bufferLength);
         
-        float rmix1 = 1.0 - pBalance;
-        float rmix2 = pBalance;
         
-        // preMixing
-        // should mix all pitched buffer together before the reverb
-        for (int channel = 0; channel < totalNumInputChannels; ++channel)
+        // final mixing
+        if (masterDry.isSmoothing() || masterWet.isSmoothing())
         {
-            const float* pitchInBufferData1 = mPitchBuffer[0].getReadPointer(channel);
-            const float* pitchInBufferData2 = mPitchBuffer[1].getReadPointer(channel);
-            
-            float* preMixBufferData = preMixBuffer.getWritePointer(channel);
-            
+            // the ramps are the same for every channel, so work them out once
+            float* dryGains = mixGainBuffer.getWritePointer(0);
+            float* wetGains = mixGainBuffer.getWritePointer(1);
             for (int sample = 0; sample < bufferLength; ++sample)
             {
-                // mix the pitched signal together using, mixing paramaters
-                preMixBufferData[sample] = pitchInBufferData1[sample] * rmix1 + pitchInBufferData2[sample] * rmix2;
+                dryGains[sample] = masterDry.getNextValue();
+                wetGains[sample] = masterWet.getNextValue();
+            }
+            
+            for (int channel = 0; channel < totalNumInputChannels; ++channel)
+            {
+                float* outbufferData = buffer.getWritePointer(channel);
+                const float* preMixBufferData = wetBuffer.getReadPointer(channel);
+                
+                for (int sample = 0; sample < bufferLength; ++sample)
+                    outbufferData[sample] = outbufferData[sample]*dryGains[sample] + wetGains[sample]*preMixBufferData[sample];
             }
         }
+        else
+        {
+            for (int channel = 0; channel < totalNumInputChannels; ++channel)
+            {
+                float* outbufferData = buffer.getWritePointer(channel);
+                
+                juce::FloatVectorOperations::multiply(outbufferData, masterDry.getTargetValue(), bufferLength);
+                
+                // add mixed signal
+                juce::FloatVectorOperations::addWithMultiply(outbufferData, wetBuffer.getReadPointer(channel), masterWet.getTargetValue(), bufferLength);
+            }
+        }
+    }
+    else
+    {
+        // keep the dry delay running, so bypassing doesn't move the audio in time
+        delayDry(buffer, totalNumInputChannels, buffer.getNumSamples());
+    }
+}
+
+void ReShimmerAudioProcessor::delayDry(juce::AudioBuffer<float>& buffer, int numChannels, int numSamples)
+{
+    // when the wet latency changes (a new stretch setting), crossfade from the old delay to the new one
+    const int previousDelay = dryDelaySamples;
+    const int targetDelay = getWetLatencySamples();
+    const float fadeStep = 1.0f / numSamples;
+    
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        auto delayed = dryDelay[channel];
+        float* data = buffer.getWritePointer(channel);
         
-        // apply Reverb to the preMixing buffer
-        updateReverbParams();    // load the params from the apvts
-        auto audioBlock = juce::dsp::AudioBlock<float>(preMixBuffer);
-        auto processContext = juce::dsp::ProcessContextReplacing<float>(audioBlock);
-        reverb.process(processContext);
+        if (targetDelay == previousDelay)
+        {
+            for (int sample = 0; sample < numSamples; ++sample)
+            {
+                delayed[sample] = data[sample];
+                data[sample] = delayed[sample - targetDelay];
+            }
+        }
+        else
+        {
+            for (int sample = 0; sample < numSamples; ++sample)
+            {
+                delayed[sample] = data[sample];
+                const float fade = (sample + 1) * fadeStep;
+                data[sample] = delayed[sample - previousDelay] * (1.0f - fade) + delayed[sample - targetDelay] * fade;
+            }
+        }
+    }
+    dryDelay += numSamples;
+    
+    // the host can only be told about the new latency from the message thread
+    if (targetDelay != previousDelay)
+    {
+        dryDelaySamples = targetDelay;
+        reportedLatency.store(targetDelay);
+        triggerAsyncUpdate();
+    }
+}
+
+int ReShimmerAudioProcessor::getWetLatencySamples() const
+{
+    const int stretchSamples = stretchLatencySamples.load(std::memory_order_relaxed) + decimator.getLatencySamples();
+    return asyncMode ? stretchSamples + asyncWet.getLatencySamples() : stretchSamples;
+}
+
+void ReShimmerAudioProcessor::handleAsyncUpdate()
+{
+    setLatencySamples(reportedLatency.load());
+    voiceWorkers.update();
+}
+
+void ReShimmerAudioProcessor::processWet(const juce::AudioBuffer<float>& input, const ParameterSnapshot& params)
+{
+    if (decimator.getFactor() == 1)
+    {
+        runWetPath(input, preMixBuffer, params);
+        return;
+    }
+    
+    // down to the wet path's rate, and back up again into preMixBuffer
+    const int bufferLength = input.getNumSamples();
+    const int lowSamples = decimator.down(input.getArrayOfReadPointers(), bufferLength, decimatedInput.getArrayOfWritePointers());
+    if (lowSamples > 0)
+    {
+        const juce::AudioBuffer<float> lowInput(decimatedInput.getArrayOfWritePointers(), input.getNumChannels(), lowSamples);
+        juce::AudioBuffer<float> lowOutput(decimatedWetBuffer.getArrayOfWritePointers(), input.getNumChannels(), lowSamples);
+        runWetPath(lowInput, lowOutput, params);
+    }
+    decimator.up(decimatedWetBuffer.getArrayOfReadPointers(), lowSamples, preMixBuffer.getArrayOfWritePointers(), bufferLength);
+}
+
+void ReShimmerAudioProcessor::runWetPath(const juce::AudioBuffer<float>& input, juce::AudioBuffer<float>& output, const ParameterSnapshot& params)
+{
+    const int numChannels = getTotalNumInputChannels();
+    const int bufferLength = input.getNumSamples();
+    
+    // a voice stays on while its gain ramps down to 0, and is skipped completely after that
+    // (when the stretch latency or quality changes, the voices fade out first, so the stretcher can be reconfigured without a click)
+    const bool stretchChanged = params.latency != currentParams.latency || params.stretchQuality != currentParams.stretchQuality;
+    const float silentGains[maxPitchVoices] = {};
+    const float* targetGains = stretchChanged ? silentGains : params.gain;
+    
+    // (the reverb ramps its own levels, so it only needs to hear about changes)
+    if (params.reverbChanged(currentParams))
+        updateReverbParams(params);
+    if (params.reverbQuality != currentParams.reverbQuality)
+        reverb.setQuality(params.reverbQuality == 0 ? ShimmerReverb::Quality::eco : ShimmerReverb::Quality::high);
+    // (starting or stopping the worker threads isn't real-time safe, so that happens on the message thread)
+    if (voiceWorkers.setEnabled(params.parallelVoices))
+        triggerAsyncUpdate();
+    
+    // a new pitch starts with this block's input, and the stretcher applies it when its processing reaches that point
+    // (so it lines up with the audio whatever the block size, rather than jumping ahead by the stretcher's latency)
+    for (int v = 0; v < maxPitchVoices; ++v)
+    {
+        if (params.pitch[v] != currentParams.pitch[v])
+            stretch.scheduleVoiceTransposeSemitones(v, 0, params.pitch[v], tonalityLimit);
+    }
+    
+    // wake the wet path up as soon as there's some input again
+    // it was only put to sleep once everything had decayed, so starting again from silence doesn't click
+    const bool inputSilent = input.getMagnitude(0, bufferLength) < idleThreshold;
+    silentInputSamples = inputSilent ? silentInputSamples + bufferLength : 0;
+    if (wetIdle && ! inputSilent)
+    {
+        stretch.reset();
+        reverb.reset();
+        wetIdle = false;
+    }
+    
+    if (wetIdle)
+    {
+        // dry-only: skip the stretcher and the reverb completely
+        for (int v = 0; v < maxPitchVoices; ++v)
+            voiceGains[v] = targetGains[v];
+        output.clear();
+    }
+    else
+    {
+        for (int v = 0; v < maxPitchVoices; ++v)
+            stretch.setVoiceActive(v, targetGains[v] > 0.0f || voiceGains[v] > 0.0f);
         
+        // all pitch voices share a single analysis of the input
+        float* const* pitchOutBuffers[maxPitchVoices];
+        for (int v = 0; v < maxPitchVoices; ++v)
+            pitchOutBuffers[v] = mPitchBuffer[v].getArrayOfWritePointers();
+        stretch.processVoices(input.getArrayOfReadPointers(), bufferLength, pitchOutBuffers, bufferLength);
         
-        // final mixing
-        for (int channel = 0; channel < totalNumInputChannels; ++channel)
+        
+        int numActiveVoices = 0;
+        int activeVoices[maxPitchVoices];
+        float startGains[maxPitchVoices], gainSteps[maxPitchVoices];
+        for (int v = 0; v < maxPitchVoices; ++v)
         {
-            
-            float* outbufferData = buffer.getWritePointer(channel);
-            const float* preMixBufferData = preMixBuffer.getReadPointer(channel);
-            
-            for (int sample = 0; sample < bufferLength; ++sample)
+            if (stretch.voiceActive(v))
             {
-                outbufferData[sample] *= masterDry;
-                
-                // add mixed signal
-                outbufferData[sample] += masterWet*preMixBufferData[sample];
+                activeVoices[numActiveVoices] = v;
+                startGains[numActiveVoices] = voiceGains[v];
+                gainSteps[numActiveVoices] = (targetGains[v] - voiceGains[v]) / bufferLength;
+                ++numActiveVoices;
             }
-            
+            voiceGains[v] = targetGains[v];
         }
         
+        // preMixing
+        // should mix all pitched buffer together before the reverb
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            const float* pitchInBufferData[maxPitchVoices];
+            for (int i = 0; i < numActiveVoices; ++i)
+                pitchInBufferData[i] = mPitchBuffer[activeVoices[i]].getReadPointer(channel);
         
-        // update parameters
+            float* preMixBufferData = output.getWritePointer(channel);
+        
+            // mix the pitched signal together using, mixing paramaters
+            mixVoices(numActiveVoices, preMixBufferData, pitchInBufferData, startGains, gainSteps, bufferLength);
+        }
         
-        const int pitch1 = apvts.getRawParameterValue("PITCH1")->load();
-        const int pitch2 = apvts.getRawParameterValue("PITCH2")->load();
-        const int tonalityLimit = 8000;
+        // apply Reverb to the preMixing buffer
+        // (a mono bus runs the reverb with the same channel on both sides)
+        float* reverbLeft = output.getWritePointer(0);
+        float* reverbRight = output.getWritePointer(numChannels > 1 ? 1 : 0);
+        reverb.process(reverbLeft, reverbRight, bufferLength);
         
-        stretch[0].setTransposeSemitones(pitch1, tonalityLimit);
-        stretch[1].setTransposeSemitones(pitch2, tonalityLimit);
+        // once the input has had time to clear the stretcher, and the reverb tail has died away, we can go idle
+        const int stretchSamples = stretch.inputLatency() + stretch.outputLatency();
+        wetIdle = silentInputSamples > stretchSamples && output.getMagnitude(0, bufferLength) < idleThreshold;
+    }
+    
+    
+    // the voices have faded out now, and fade back in from silence as the stretcher starts up again
+    // (everything was reserved in prepareToPlay(), so this doesn't allocate)
+    if (stretchChanged)
+    {
+        configureStretch(params, wetSampleRate);
+        stretch.reset();
+    }
+    
+    currentParams = params;
+}
+
+void ReShimmerAudioProcessor::configureStretch(const ParameterSnapshot& params, double sampleRate)
+{
+    const auto settings = StretchSettings::forSetting(params.latency, params.stretchQuality, sampleRate);
+    // (async mode always hands the stretcher whole intervals, so it never needs spreading out)
+    stretch.setAmortised(! asyncMode && settings.shouldAmortise(hostLowBlockSamples));
+    stretch.configure(getTotalNumInputChannels(), settings.blockSamples, settings.intervalSamples, maxPitchVoices);
+    
+    // (the audio thread picks this up for the dry delay, even when the wet path is on the async thread)
+    const int latencySamples = (stretch.inputLatency() + stretch.outputLatency()) * decimator.getFactor();
+    stretchLatencySamples.store(latencySamples, std::memory_order_relaxed);
+}
 
+ReShimmerAudioProcessor::ParameterSnapshot ReShimmerAudioProcessor::loadParameters() const
+{
+    ParameterSnapshot params;
+    params.bypassed = parameterPointers.bypass->load() >= 0.5f;
+    params.dry = parameterPointers.dry->load();
+    params.wet = parameterPointers.wet->load();
+    for (int v = 0; v < maxPitchVoices; ++v)
+    {
+        params.pitch[v] = (int) parameterPointers.pitch[v]->load();
+        params.gain[v] = parameterPointers.gain[v]->load();
     }
+    params.roomSize = parameterPointers.roomSize->load();
+    params.damping = parameterPointers.damping->load();
+    params.reverbMix = parameterPointers.reverbMix->load();
+    params.width = parameterPointers.width->load();
+    params.freeze = parameterPointers.freeze->load();
+    params.reverbQuality = (int) parameterPointers.reverbQuality->load();
+    params.stretchQuality = (int) parameterPointers.stretchQuality->load();
+    params.latency = (int) parameterPointers.latency->load();
+    params.parallelVoices = parameterPointers.parallelVoices->load() >= 0.5f;
+    return params;
+}
+
+bool ReShimmerAudioProcessor::ParameterSnapshot::reverbChanged(const ParameterSnapshot& other) const
+{
+    return roomSize != other.roomSize || damping != other.damping || reverbMix != other.reverbMix
+        || width != other.width || freeze != other.freeze;
 }
 
-void ReShimmerAudioProcessor::updateReverbParams()
+void ReShimmerAudioProcessor::updateReverbParams(const ParameterSnapshot& params)
 {
-    const float reverbMix = apvts.getRawParameterValue("REVERBMIX")->load();
-    const float roomSize = apvts.getRawParameterValue("ROOMSIZE")->load();
-    reverbParams.roomSize = roomSize;
-    reverbParams.damping = apvts.getRawParameterValue("DAMPING")->load();
+    reverbParams.roomSize = params.roomSize;
+    reverbParams.damping = params.damping;
     
     // get the levels in the mix between reverb dry/wet correct by testings ...
-    reverbParams.wetLevel = reverbMix * (1-0.7*roomSize);
-    reverbParams.dryLevel = 1.0 - reverbMix;
+    reverbParams.wetLevel = params.reverbMix * (1-0.7*params.roomSize);
+    reverbParams.dryLevel = 1.0 - params.reverbMix;
     
-    reverbParams.width = apvts.getRawParameterValue("WIDTH")->load();
-    reverbParams.freezeMode = apvts.getRawParameterValue("FREEZE")->load();
+    reverbParams.width = params.width;
+    reverbParams.freezeMode = params.freeze;
 
     reverb.setParameters(reverbParams);
 }
@@ -371,7 +792,11 @@ void ReShimmerAudioProcessor::setStateInformation (const void* data, int sizeInB
      
     if (xmlState.get() != nullptr)
         if (xmlState->hasTagName (apvts.state.getType()))
-            apvts.replaceState (juce::ValueTree::fromXml (*xmlState));
+        {
+            auto state = juce::ValueTree::fromXml (*xmlState);
+            migratePitchBalance (state);
+            apvts.replaceState (state);
+        }
 }
 
 
@@ -389,10 +814,14 @@ juce::AudioProcessorValueTreeState::ParameterLayout ReShimmerAudioProcessor::cre
     layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("DRY", 1), "Dry", 0.0, 1.0, 1.0));
     layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("WET", 1), "Wet", 0.0, 1.0, 1.0));
     
-    // pitch parameters
-    layout.add(std::make_unique<juce::AudioParameterInt>(juce::ParameterID("PITCH1", 1), "Pitch1", -12, 24, 0));
-    layout.add(std::make_unique<juce::AudioParameterInt>(juce::ParameterID("PITCH2", 1), "Pitch2", -12, 24, 0));
-    layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("PBALANCE", 1), "PBalance", 0.0, 1.0, 0.5));
+    // pitch parameters, an interval and a gain for each voice
+    // (only the first two voices are on by default)
+    for (int v = 0; v < maxPitchVoices; ++v)
+    {
+        const juce::String number(v + 1);
+        layout.add(std::make_unique<juce::AudioParameterInt>(juce::ParameterID(pitchParamIDs[v], 1), "Pitch" + number, -12, 24, 0));
+        layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID(gainParamIDs[v], 1), "Gain" + number, 0.0, 1.0, v < 2 ? 0.5 : 0.0));
+    }
 
     // reverb parameters
     layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("ROOMSIZE", 1), "RoomSize", 0.0, 1.0, 0.5));
@@ -400,6 +829,23 @@ juce::AudioProcessorValueTreeState::ParameterLayout ReShimmerAudioProcessor::cre
     layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("REVERBMIX", 1), "ReverbMix", 0.0, 1.0, 0.5));
     layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("WIDTH", 1), "Width", 0.0, 1.0, 1.0));
     layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("FREEZE", 1), "Freeze", 0.0, 1.0, 0.0));
+    // eco runs an 8-channel network (a little cheaper than the JUCE reverb it replaced), high a 16-channel one
+    // (denser, for about twice the CPU)
+    layout.add(std::make_unique<juce::AudioParameterChoice>(juce::ParameterID("REVERBQUALITY", 1), "ReverbQuality", juce::StringArray { "Eco", "High" }, 0));
+    // the pitch-shifter's overlap: cheaper analyses less often, high more often (for about 1.5x the CPU)
+    layout.add(std::make_unique<juce::AudioParameterChoice>(juce::ParameterID("STRETCHQUALITY", 1), "StretchQuality", juce::StringArray { "Cheaper", "Default", "High" }, 1));
+    // the pitch-shifter's window: 20ms / 40ms / 120ms, shorter for live monitoring, longer for a smoother sound
+    layout.add(std::make_unique<juce::AudioParameterChoice>(juce::ParameterID("LATENCY", 1), "Latency", juce::StringArray { "Low", "Medium", "Normal" }, 2));
+    
+    // spreads the pitch voices over a few real-time threads, for hosts which only give the plugin one
+    // (the threads only exist while this is on, and wait to be woken between blocks)
+    layout.add(std::make_unique<juce::AudioParameterBool>(juce::ParameterID("PARALLELVOICES", 1), "ParallelVoices", false));
+    // runs the stretcher and reverb on their own thread, for a steady load with small host blocks (this adds latency,
+    // and only takes effect the next time playback is prepared)
+    layout.add(std::make_unique<juce::AudioParameterBool>(juce::ParameterID("ASYNCMODE", 1), "AsyncMode", false));
+    // at 88.2kHz and above, runs the stretcher and reverb at 44.1/48kHz (nothing above 20kHz is kept in the wet signal,
+    // and this also only takes effect the next time playback is prepared)
+    layout.add(std::make_unique<juce::AudioParameterBool>(juce::ParameterID("DECIMATEDWET", 1), "DecimatedWet", true));
     
 
     
@@ -13,11 +13,17 @@
 //#include <juce_Reverb.h>
 
 #include "stretch/signalsmith-stretch.h"
+#include "ShimmerReverb.h"
+#include "VoiceWorkerPool.h"
+#include "AsyncWetProcessor.h"
+#include "StretchSettings.h"
+#include "WetDecimator.h"
 
 //==============================================================================
 /**
 */
-class ReShimmerAudioProcessor  : public juce::AudioProcessor
+class ReShimmerAudioProcessor  : public juce::AudioProcessor,
+                                 private juce::AsyncUpdater
 {
 public:
     //==============================================================================
@@ -59,14 +65,74 @@ public:
         
     
     juce::AudioProcessorParameter* getBypassParameter() const override;
+    
+    // for offline rendering which starts part-way through the input: call after prepareToPlay() with the input
+    // just before the start, so the stretcher's first analysis isn't of silence
+    // (the reverb still has to be warmed up by processing some input normally)
+    void seekInput(const juce::AudioBuffer<float>& preRoll);
+    int getSeekSamples() const;
+    
     juce::AudioProcessorValueTreeState apvts { *this, nullptr, "Parameters", createParameterLayout() };
     juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
     
 private:
     
-    const int numPitchBuffer = 2;
-    signalsmith::stretch::SignalsmithStretch<float> stretch[2];
-    juce::AudioBuffer<float> mPitchBuffer[2];
+    // one stretcher with a voice per pitch, so the input analysis is only done once
+    static constexpr int maxPitchVoices = 8;
+    
+    // the raw parameter values, looked up once so the audio thread never searches by ID
+    struct ParameterPointers
+    {
+        std::atomic<float>* bypass = nullptr;
+        std::atomic<float>* dry = nullptr;
+        std::atomic<float>* wet = nullptr;
+        std::atomic<float>* pitch[maxPitchVoices] = {};
+        std::atomic<float>* gain[maxPitchVoices] = {};
+        std::atomic<float>* roomSize = nullptr;
+        std::atomic<float>* damping = nullptr;
+        std::atomic<float>* reverbMix = nullptr;
+        std::atomic<float>* width = nullptr;
+        std::atomic<float>* freeze = nullptr;
+        std::atomic<float>* reverbQuality = nullptr;
+        std::atomic<float>* stretchQuality = nullptr;
+        std::atomic<float>* latency = nullptr;
+        std::atomic<float>* parallelVoices = nullptr;
+        std::atomic<float>* asyncMode = nullptr;
+        std::atomic<float>* decimatedWet = nullptr;
+    };
+    ParameterPointers parameterPointers;
+    
+    // every parameter value for one block, read in one go at the start of the block
+    struct ParameterSnapshot
+    {
+        bool bypassed = false;
+        float dry = 1.0f, wet = 1.0f;
+        int pitch[maxPitchVoices] = {};
+        float gain[maxPitchVoices] = {};
+        float roomSize = 0.5f, damping = 0.5f, reverbMix = 0.5f, width = 1.0f, freeze = 0.0f;
+        int reverbQuality = 0;
+        int stretchQuality = 1;
+        int latency = 2;
+        bool parallelVoices = false;
+        
+        bool reverbChanged(const ParameterSnapshot& other) const;
+    };
+    ParameterSnapshot loadParameters() const;
+    
+    // the values that were last applied to the DSP, so unchanged parameters can skip their update
+    ParameterSnapshot currentParams;
+    
+    // dry/wet are ramped per-sample, so moving them doesn't zipper
+    juce::SmoothedValue<float> masterDry, masterWet;
+    juce::AudioBuffer<float> mixGainBuffer;
+    // fixed seed, so any randomised time-factors come out the same on every run
+    signalsmith::stretch::SignalsmithStretch<float> stretch { 12345 };
+    // (opt-in) helper threads which share the voices' synthesis with the audio thread
+    VoiceWorkerPool voiceWorkers;
+    juce::AudioBuffer<float> mPitchBuffer[maxPitchVoices];
+    
+    // gain of each voice at the end of the last block, the premix ramps from here
+    float voiceGains[maxPitchVoices] = {};
 
     juce::AudioBuffer<float> tempBuffer;
     
@@ -74,11 +140,46 @@ private:
     juce::AudioBuffer<float> preMixBuffer;
     
     
-    juce::dsp::Reverb reverb;
-    juce::dsp::Reverb::Parameters reverbParams;
+    ShimmerReverb reverb;
+    ShimmerReverbParameters reverbParams;
+    
+    
+    void updateReverbParams(const ParameterSnapshot& params);
+    
+    // sets the stretcher up for the latency and quality settings (this can be done on the audio thread)
+    void configureStretch(const ParameterSnapshot& params, double sampleRate);
+    // (in full-rate samples, even when the wet path is decimated)
+    std::atomic<int> stretchLatencySamples { 0 };
+    
+    // the dry signal is delayed by as much as the wet path's latency, which is what's reported to the host
+    signalsmith::delay::MultiBuffer<float> dryDelay;
+    int dryDelaySamples = 0;
+    std::atomic<int> reportedLatency { 0 };
+    int getWetLatencySamples() const;
+    void delayDry(juce::AudioBuffer<float>& buffer, int numChannels, int numSamples);
+    void handleAsyncUpdate() override;
+    
+    // the stretcher, the voice mix and the reverb: reads the input and leaves the wet signal in preMixBuffer
+    // (on the audio thread, or on the async thread in async mode)
+    void processWet(const juce::AudioBuffer<float>& input, const ParameterSnapshot& params);
+    // the same, at the wet path's sample rate
+    void runWetPath(const juce::AudioBuffer<float>& input, juce::AudioBuffer<float>& output, const ParameterSnapshot& params);
+    
+    // (opt-out) at 88.2kHz and above the wet path runs at half or a quarter of the rate, with the dry path still at the full rate
+    WetDecimator decimator;
+    juce::AudioBuffer<float> decimatedInput, decimatedWetBuffer;
+    double wetSampleRate = 44100.0;
     
+    // (opt-in) the wet path runs on a background thread in interval-sized chunks, and the audio thread only copies
+    AsyncWetProcessor asyncWet;
+    juce::AudioBuffer<float> asyncWetBuffer;
+    bool asyncMode = false;
+    // the host's largest block at the wet path's rate: below an interval, the stretcher spreads its work out
+    int hostLowBlockSamples = 0;
     
-    void updateReverbParams();
+    // when the input has been silent for a while and everything has decayed, the stretcher and reverb are skipped
+    bool wetIdle = false;
+    int silentInputSamples = 0;
     
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ReShimmerAudioProcessor)
@@ -0,0 +1,460 @@
+/*
+  ==============================================================================
+
+    Feedback-delay-network reverb for the shimmer path.
+
+    The stereo input is spread across N channels, diffused by a few rounds of
+    delay + Hadamard mixing, and then fed into a Householder feedback loop.
+    Each stage works on a chunk of samples at a time, so the inner loops run
+    along contiguous rows which the compiler turns into SIMD.
+
+    It only depends on the bundled Signalsmith DSP library (not JUCE), so it
+    can also be used from the command-line tools.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "stretch/dsp/delay.h"
+#include "stretch/dsp/mix.h"
+
+#include <array>
+#include <cmath>
+#include <random>
+
+// The same parameters as juce::dsp::Reverb, so the plugin's mapping carries straight over
+struct ShimmerReverbParameters
+{
+    float roomSize = 0.5f;
+    float damping = 0.5f;
+    float wetLevel = 0.33f;
+    float dryLevel = 0.4f;
+    float width = 1.0f;
+    float freezeMode = 0.0f;
+};
+
+template <int channels>
+class FdnReverb
+{
+    static_assert(channels >= 2 && (channels & (channels - 1)) == 0, "the Hadamard diffusers need a power-of-2 channel count");
+
+    // Samples are processed in chunks, with one row per channel, so every stage is a loop along a row
+    // which vectorises, instead of a loop across channels for each sample.
+    static constexpr int chunkSize = 64;
+    using Row = std::array<float, chunkSize>;
+    using Rows = std::array<Row, channels>;
+    using MultiBuffer = signalsmith::delay::MultiBuffer<float>;
+
+    static constexpr int diffusionSteps = 4;
+    static constexpr double diffusionSeconds = 0.05;     // total length of the diffuser, split between the steps
+    static constexpr double feedbackSeconds = 0.1;       // longest feedback delay, the shortest is half of this
+
+    struct DiffusionStep
+    {
+        MultiBuffer delay;
+        std::array<int, channels> delaySamples;
+        std::array<float, channels> polarity;
+    };
+    std::array<DiffusionStep, diffusionSteps> diffusers;
+
+    // the feedback delays are all longer than a chunk, so a whole chunk can be read before any of it is written
+    MultiBuffer feedbackDelay;
+    std::array<int, channels> feedbackDelaySamples;
+
+    // The stereo up/down-mix, as one coefficient per channel for each side
+    // (taken from the mixer at startup, so the mixing can also be done along rows)
+    std::array<float, channels> fromLeft, fromRight, toLeft, toRight;
+
+    double sampleRate = 44100;
+    ShimmerReverbParameters params;
+
+    Rows diffused, feedback;
+    // (with one sample before the chunk, for the damping filter)
+    std::array<std::array<float, chunkSize + 1>, channels> delayed;
+
+    // Everything that can change with the parameters is ramped across each block, so automation doesn't zipper
+    struct Ramp
+    {
+        float value = 0, step = 0;
+
+        float at(int i) const
+        {
+            return value + step * (float) i;
+        }
+        void advance(int numSamples)
+        {
+            value += step * (float) numSamples;
+        }
+    };
+    std::array<Ramp, channels> decayGain;
+    Ramp damping, inputGain, wetSame, wetCross, dry;
+
+    struct Targets
+    {
+        std::array<float, channels> decayGain;
+        float damping, inputGain, wetSame, wetCross, dry;
+    };
+    // worked out when the parameters are set, and only ramped towards in the next block after that
+    Targets targets;
+    bool ramping = false;
+
+    Targets calculateTargets() const
+    {
+        Targets t;
+        const bool frozen = params.freezeMode >= 0.5f;
+
+        // each channel loses -60dB over the decay time, scaled by how long its delay is
+        const double decaySeconds = FdnReverb::decaySeconds(params.roomSize);
+        for (int c = 0; c < channels; ++c)
+        {
+            const double loopSeconds = feedbackDelaySamples[c] / sampleRate;
+            t.decayGain[c] = frozen ? 1.0f : (float) std::pow(10.0, -3.0 * loopSeconds / decaySeconds);
+        }
+        // a frozen reverb neither takes in new input nor loses any energy
+        t.damping = frozen ? 0.0f : params.damping * 0.4f;
+        t.inputGain = frozen ? 0.0f : 1.0f;
+
+        const float wet = params.wetLevel * wetScale;
+        t.wetSame = 0.5f * wet * (1.0f + params.width);
+        t.wetCross = 0.5f * wet * (1.0f - params.width);
+        t.dry = params.dryLevel * dryScale;
+        return t;
+    }
+
+    void setRamps(const Targets& t, int numSamples, bool jump)
+    {
+        auto set = [&](Ramp& ramp, float target) {
+            if (jump)
+                ramp.value = target;
+            ramp.step = (target - ramp.value) / (float) numSamples;
+        };
+        for (int c = 0; c < channels; ++c)
+            set(decayGain[c], t.decayGain[c]);
+        set(damping, t.damping);
+        set(inputGain, t.inputGain);
+        set(wetSame, t.wetSame);
+        set(wetCross, t.wetCross);
+        set(dry, t.dry);
+    }
+
+    void processChunk(float* left, float* right, int numSamples)
+    {
+        // spread the stereo input across all the channels
+        for (int c = 0; c < channels; ++c)
+        {
+            float* row = diffused[c].data();
+            const float leftGain = fromLeft[c], rightGain = fromRight[c];
+            for (int i = 0; i < numSamples; ++i)
+                row[i] = (left[i] * leftGain + right[i] * rightGain) * inputGain.at(i);
+        }
+
+        // the delays are read and written as whole spans of the buffer (split only where it wraps), not indexed per sample
+        const float hadamardScale = signalsmith::mix::Hadamard<float, channels>::scalingFactor();
+        for (auto& diffuser : diffusers)
+        {
+            // write the whole chunk first, so delays shorter than the chunk read what was just written
+            auto view = diffuser.delay.view();
+            for (int c = 0; c < channels; ++c)
+                (view[c] + 1).write(diffused[c], numSamples);
+            for (int c = 0; c < channels; ++c)
+            {
+                float* row = diffused[c].data();
+                const auto spans = view[c].spans(1 - diffuser.delaySamples[c], numSamples);
+                const float gain = diffuser.polarity[c] * hadamardScale;
+                for (int i = 0; i < spans.firstLength; ++i)
+                    row[i] = spans.first[i] * gain;
+                for (int i = 0; i < spans.secondLength; ++i)
+                    row[spans.firstLength + i] = spans.second[i] * gain;
+            }
+            diffuser.delay += numSamples;
+
+            hadamardRows(diffused, numSamples);
+        }
+
+        // read the delayed chunk, with a two-tap lowpass for the damping
+        // (an FIR, rather than the recursive lowpass Freeverb uses, so it works along a row)
+        {
+            auto view = feedbackDelay.view();
+            for (int c = 0; c < channels; ++c)
+            {
+                // one extra sample at the start, for the lowpass's previous tap
+                float* output = delayed[c].data();
+                (view[c] - feedbackDelaySamples[c]).read(numSamples + 1, output);
+                float* filtered = feedback[c].data();
+                for (int i = 0; i < numSamples; ++i)
+                {
+                    const float previous = output[i], current = output[i + 1];
+                    filtered[i] = current + (previous - current) * damping.at(i);
+                }
+            }
+        }
+
+        // Householder mix: subtract 2/N of the sum from every channel
+        {
+            Row sum;
+            for (int i = 0; i < numSamples; ++i)
+                sum[i] = feedback[0][i];
+            for (int c = 1; c < channels; ++c)
+                for (int i = 0; i < numSamples; ++i)
+                    sum[i] += feedback[c][i];
+            const float factor = -2.0f / channels;
+            for (int i = 0; i < numSamples; ++i)
+                sum[i] *= factor;
+            for (int c = 0; c < channels; ++c)
+            {
+                const Ramp gain = decayGain[c];
+                float* row = feedback[c].data();
+                const float* input = diffused[c].data();
+                for (int i = 0; i < numSamples; ++i)
+                    row[i] = (row[i] + sum[i]) * gain.at(i) + input[i];
+            }
+        }
+
+        {
+            auto view = feedbackDelay.view();
+            for (int c = 0; c < channels; ++c)
+                (view[c] + 1).write(feedback[c], numSamples);
+            feedbackDelay += numSamples;
+        }
+
+        // back down to stereo, and mix with the dry signal
+        {
+            Row outLeft {}, outRight {};
+            for (int c = 0; c < channels; ++c)
+            {
+                const float* row = delayed[c].data() + 1;
+                const float leftGain = toLeft[c], rightGain = toRight[c];
+                for (int i = 0; i < numSamples; ++i)
+                {
+                    outLeft[i] += row[i] * leftGain;
+                    outRight[i] += row[i] * rightGain;
+                }
+            }
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const float same = wetSame.at(i), cross = wetCross.at(i), dryGain = dry.at(i);
+                left[i] = left[i] * dryGain + outLeft[i] * same + outRight[i] * cross;
+                right[i] = right[i] * dryGain + outRight[i] * same + outLeft[i] * cross;
+            }
+        }
+
+        for (auto& ramp : decayGain)
+            ramp.advance(numSamples);
+        damping.advance(numSamples);
+        inputGain.advance(numSamples);
+        wetSame.advance(numSamples);
+        wetCross.advance(numSamples);
+        dry.advance(numSamples);
+    }
+
+    // Unscaled Hadamard, as butterflies between whole rows
+    // Two stages are done per pass where possible (4 rows at a time), so there are half as many passes over the rows.
+    static void hadamardRows(Rows& rows, int numSamples)
+    {
+        int h = channels / 2;
+        for (; h >= 2; h /= 4)
+        {
+            const int q = h / 2;
+            for (int start = 0; start < channels; start += 2 * h)
+            {
+                for (int c = start; c < start + q; ++c)
+                {
+                    float* a = rows[c].data();
+                    float* b = rows[c + q].data();
+                    float* x = rows[c + h].data();
+                    float* y = rows[c + h + q].data();
+                    for (int i = 0; i < numSamples; ++i)
+                    {
+                        // stage h, then stage h/2
+                        const float sumA = a[i] + x[i], diffA = a[i] - x[i];
+                        const float sumB = b[i] + y[i], diffB = b[i] - y[i];
+                        a[i] = sumA + sumB;
+                        b[i] = sumA - sumB;
+                        x[i] = diffA + diffB;
+                        y[i] = diffA - diffB;
+                    }
+                }
+            }
+        }
+        if (h == 1)
+        {
+            for (int c = 0; c < channels; c += 2)
+            {
+                float* a = rows[c].data();
+                float* b = rows[c + 1].data();
+                for (int i = 0; i < numSamples; ++i)
+                {
+                    const float sum = a[i] + b[i], diff = a[i] - b[i];
+                    a[i] = sum;
+                    b[i] = diff;
+                }
+            }
+        }
+    }
+
+public:
+    // Level matching against juce::dsp::Reverb at the same settings, which scales its levels internally
+    static constexpr float wetScale = 1.1f;
+    static constexpr float dryScale = 2.0f;
+
+    // The -60dB decay time for a room size, using the same room-size-to-feedback mapping as juce::dsp::Reverb
+    // (whose longest comb is 1617 samples at 44.1kHz), so existing settings keep their length
+    static double decaySeconds(float roomSize)
+    {
+        const double feedback = roomSize * 0.28 + 0.7;
+        const double combSeconds = 1617.0 / 44100.0;
+        return combSeconds * std::log(0.001) / std::log(feedback);
+    }
+
+    void prepare(double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+
+        // the mixer is linear, so unit inputs give its coefficients
+        signalsmith::mix::StereoMultiMixer<float, channels> stereoMixer;
+        const float downmixScale = stereoMixer.scalingFactor2();
+        for (int c = 0; c < channels; ++c)
+        {
+            std::array<float, 2> stereo;
+            std::array<float, channels> multi {};
+            multi[c] = downmixScale;
+            stereoMixer.multiToStereo(multi, stereo);
+            toLeft[c] = stereo[0];
+            toRight[c] = stereo[1];
+        }
+        for (int side = 0; side < 2; ++side)
+        {
+            std::array<float, 2> stereo {};
+            std::array<float, channels> multi;
+            stereo[side] = 1.0f;
+            stereoMixer.stereoToMulti(stereo, multi);
+            (side == 0 ? fromLeft : fromRight) = multi;
+        }
+
+        // fixed pseudo-random delays, so every instance sounds the same
+        std::mt19937 randomEngine(12345);
+        std::uniform_real_distribution<double> unitRange(0, 1);
+
+        // the diffusers split their range into one slot per channel, so the delays are spread out evenly
+        const double stepSamples = diffusionSeconds * sampleRate / diffusionSteps;
+        for (auto& diffuser : diffusers)
+        {
+            for (int c = 0; c < channels; ++c)
+            {
+                const double low = stepSamples * c / channels, high = stepSamples * (c + 1) / channels;
+                diffuser.delaySamples[c] = std::max(1, (int) (low + unitRange(randomEngine) * (high - low)));
+                diffuser.polarity[c] = (randomEngine() & 1) ? 1.0f : -1.0f;
+            }
+            diffuser.delay.resize(channels, (int) stepSamples + chunkSize + 1);
+        }
+
+        // exponentially spaced feedback delays between half and all of the full length
+        const double maxFeedbackSamples = feedbackSeconds * sampleRate;
+        for (int c = 0; c < channels; ++c)
+        {
+            const double r = (c + unitRange(randomEngine) * 0.5) / channels;
+            feedbackDelaySamples[c] = std::max(chunkSize + 1, (int) (maxFeedbackSamples * std::pow(2.0, r - 1.0)));
+        }
+        feedbackDelay.resize(channels, (int) maxFeedbackSamples + chunkSize + 2);
+
+        reset();
+        targets = calculateTargets();
+        setRamps(targets, 1, true);
+        ramping = false;
+    }
+
+    void reset()
+    {
+        for (auto& diffuser : diffusers)
+            diffuser.delay.reset();
+        feedbackDelay.reset();
+    }
+
+    void setParameters(const ShimmerReverbParameters& newParams)
+    {
+        params = newParams;
+        targets = calculateTargets();
+        ramping = true;
+    }
+
+    // Stereo, in-place
+    void process(float* left, float* right, int numSamples)
+    {
+        if (numSamples <= 0)
+            return;
+        if (ramping)
+            setRamps(targets, numSamples, false);
+
+        for (int start = 0; start < numSamples; start += chunkSize)
+        {
+            const int length = std::min(chunkSize, numSamples - start);
+            processChunk(left + start, right + start, length);
+        }
+
+        // land exactly on the targets, so rounding in the ramps can't build up
+        // (after which nothing moves until the parameters are set again)
+        if (ramping)
+        {
+            setRamps(targets, 1, true);
+            ramping = false;
+        }
+    }
+};
+
+// Picks between an 8- and 16-channel network
+// More channels give a denser, smoother tail for roughly twice the CPU.
+class ShimmerReverb
+{
+public:
+    enum class Quality { eco, high };
+
+    void prepare(double sampleRate)
+    {
+        eco.prepare(sampleRate);
+        high.prepare(sampleRate);
+    }
+
+    void reset()
+    {
+        eco.reset();
+        high.reset();
+    }
+
+    // The networks don't share any state, so switching starts the new one from silence
+    void setQuality(Quality newQuality)
+    {
+        if (newQuality == quality)
+            return;
+        quality = newQuality;
+        reset();
+    }
+    Quality getQuality() const
+    {
+        return quality;
+    }
+
+    void setParameters(const ShimmerReverbParameters& params)
+    {
+        eco.setParameters(params);
+        high.setParameters(params);
+    }
+
+    void process(float* left, float* right, int numSamples)
+    {
+        if (quality == Quality::high)
+            high.process(left, right, numSamples);
+        else
+            eco.process(left, right, numSamples);
+    }
+
+    static double decaySeconds(float roomSize)
+    {
+        return FdnReverb<8>::decaySeconds(roomSize);
+    }
+
+private:
+    Quality quality = Quality::eco;
+    FdnReverb<8> eco;
+    FdnReverb<16> high;
+};
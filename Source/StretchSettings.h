@@ -0,0 +1,62 @@
+/*
+  ==============================================================================
+
+    The stretcher's block (window) and interval for each latency and quality
+    setting.
+
+    The latency setting picks the window length, which is most of the
+    stretcher's latency, and the quality picks how much the windows overlap.
+    Windows are rounded up to a fast FFT size, so none of the FFT is spent on
+    zero-padding.
+
+    It doesn't depend on JUCE, so the benchmarks use the same settings (and
+    switch between them the same way).
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "stretch/dsp/spectral.h"
+
+struct StretchSettings
+{
+    int blockSamples = 0, intervalSamples = 0;
+
+    static constexpr int numLatencies = 3, numQualities = 3;
+
+    // window length for low / medium / normal latency
+    static constexpr double windowSeconds[numLatencies] = { 0.02, 0.04, 0.12 };
+    // windows per interval for cheaper / default / high quality (more overlap costs more CPU)
+    static constexpr int overlaps[numQualities] = { 3, 4, 6 };
+
+    static StretchSettings forSetting(int latency, int quality, double sampleRate)
+    {
+        StretchSettings settings;
+        settings.blockSamples = signalsmith::spectral::WindowedFFT<float>::fastSizeAbove((int) (sampleRate * windowSeconds[latency]));
+        settings.intervalSamples = settings.blockSamples / overlaps[quality];
+        return settings;
+    }
+
+    // small host blocks would otherwise get all of an interval's analysis and synthesis at once,
+    // so the stretcher spreads it out (this costs one interval of extra latency)
+    bool shouldAmortise(int hostBlockSamples) const
+    {
+        return hostBlockSamples < intervalSamples;
+    }
+
+    // Allocates every setting up-front, so any of them can be configured later (e.g. on the audio thread) without allocating.
+    // The stretcher has to have been configured with all its voices first.
+    template <class Stretch>
+    static void reserveAll(Stretch& stretch, int numChannels, double sampleRate)
+    {
+        for (int latency = 0; latency < numLatencies; ++latency)
+        {
+            for (int quality = 0; quality < numQualities; ++quality)
+            {
+                const auto settings = forSetting(latency, quality, sampleRate);
+                stretch.reserve(numChannels, settings.blockSamples, settings.intervalSamples);
+            }
+        }
+    }
+};
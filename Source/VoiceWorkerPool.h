@@ -0,0 +1,228 @@
+/*
+  ==============================================================================
+
+    A few real-time worker threads which share the pitch voices' synthesis
+    with the audio thread.
+
+    Jobs are handed over through a single atomic word (no locks, and nothing
+    is allocated).  Jobs aren't assigned to particular workers: the audio
+    thread claims them alongside the workers, so if no worker is awake in time
+    it just runs them all itself, and it only ever waits for jobs which a
+    worker has already started.
+
+    The threads only exist while the pool is enabled.  Between jobs a worker
+    spins for a few tens of microseconds, then waits until the audio thread
+    wakes it with the next batch.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "stretch/signalsmith-stretch.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class VoiceWorkerPool
+{
+public:
+    using VoiceJobs = signalsmith::stretch::SignalsmithStretch<float>::VoiceJobs;
+
+    // the audio thread takes a share of the voices too, so this many workers lets 4 voices run at once
+    static constexpr int maxWorkers = 3;
+
+    // after finishing a job, a worker keeps looking for another this long before it waits to be woken
+    static constexpr double spinSeconds = 50.0e-6;
+
+    VoiceWorkerPool()
+    {
+        // the Worker objects are never destroyed while the pool is in use, only their threads are stopped,
+        // so the audio thread can wake them without checking they still exist
+        for (int i = 0; i < maxWorkers; ++i)
+            workers.push_back(std::make_unique<Worker>(*this));
+    }
+
+    ~VoiceWorkerPool()
+    {
+        stop();
+    }
+
+    // Sets how many workers to use (up to maxWorkers), and starts them if the pool is enabled.
+    // This isn't real-time safe, so call it from prepareToPlay().
+    void prepare(int numWorkers, double sampleRate, int blockSize)
+    {
+        std::lock_guard<std::mutex> lock(controlMutex);
+        numPrepared = juce::jlimit(0, maxWorkers, numWorkers);
+        threadOptions = juce::Thread::RealtimeOptions{}.withApproximateAudioProcessingTime(blockSize, sampleRate);
+        stopThreads();
+        if (enabled.load(std::memory_order_relaxed))
+            startThreads();
+    }
+
+    // Stops every thread, until the next prepare()
+    void stop()
+    {
+        std::lock_guard<std::mutex> lock(controlMutex);
+        numPrepared = 0;
+        stopThreads();
+    }
+
+    // When disabled, every job runs on the calling thread.  This is real-time safe, but doesn't start or stop any
+    // threads: it returns true when update() needs calling (from another thread) to do that.
+    bool setEnabled(bool shouldBeEnabled)
+    {
+        return enabled.exchange(shouldBeEnabled, std::memory_order_relaxed) != shouldBeEnabled;
+    }
+
+    // Starts or stops the threads to match setEnabled().  Not real-time safe, so call it from the message thread.
+    void update()
+    {
+        std::lock_guard<std::mutex> lock(controlMutex);
+        if (enabled.load(std::memory_order_relaxed))
+            startThreads();
+        else
+            stopThreads();
+    }
+
+    // Runs every job, sharing them with whichever workers are awake, and returns once they've all finished
+    void run(const VoiceJobs& jobs)
+    {
+        const int numJobs = jobs.size();
+        const int numWorkers = numRunning.load(std::memory_order_acquire);
+        if (! enabled.load(std::memory_order_relaxed) || numWorkers == 0 || numJobs < 2)
+        {
+            for (int job = 0; job < numJobs; ++job)
+                jobs.run(job);
+            return;
+        }
+
+        currentJobs.store(&jobs, std::memory_order_relaxed);
+        finishedJobs.store(0, std::memory_order_relaxed);
+        claims.store(static_cast<uint32_t>(numJobs) << countShift);
+
+        // this thread takes a job too, so only wake as many workers as there are other jobs
+        // (notify() takes a lock, but it's only ever shared with that one worker going in or out of its wait)
+        for (int i = 0; i < numWorkers && i < numJobs - 1; ++i)
+        {
+            if (workers[static_cast<size_t>(i)]->waiting.exchange(false))
+                workers[static_cast<size_t>(i)]->notify();
+        }
+
+        runClaimedJobs();
+
+        // everything has been claimed, so the only jobs left are already running on a worker
+        while (finishedJobs.load(std::memory_order_acquire) < numJobs)
+            std::this_thread::yield();
+    }
+
+private:
+    // the job count and the index of the next unclaimed job, packed together so claiming is one atomic add
+    static constexpr int countShift = 16;
+    static constexpr uint32_t indexMask = (1u << countShift) - 1;
+    std::atomic<uint32_t> claims { 0 };
+    std::atomic<const VoiceJobs*> currentJobs { nullptr };
+    std::atomic<int> finishedJobs { 0 };
+    std::atomic<bool> enabled { false };
+    const juce::int64 spinTicks = juce::Time::secondsToHighResolutionTicks(spinSeconds);
+
+    // how many threads run() can hand jobs to
+    std::atomic<int> numRunning { 0 };
+
+    // (only used with controlMutex held)
+    std::mutex controlMutex;
+    int numPrepared = 0;
+    juce::Thread::RealtimeOptions threadOptions;
+
+    bool hasUnclaimedJobs() const
+    {
+        const uint32_t available = claims.load();
+        return (available & indexMask) < (available >> countShift);
+    }
+
+    // Claims and runs jobs until there are none left, and returns whether it ran any
+    bool runClaimedJobs()
+    {
+        bool ranAny = false;
+        while (true)
+        {
+            // only add to the index when there's something to claim, so idle workers can't overflow it
+            if (! hasUnclaimedJobs())
+                return ranAny;
+
+            const uint32_t claimed = claims.fetch_add(1, std::memory_order_acq_rel);
+            const uint32_t job = claimed & indexMask;
+            if (job >= (claimed >> countShift))
+                return ranAny;
+
+            // run() can't return until this job is marked finished, so the jobs are still there
+            currentJobs.load(std::memory_order_acquire)->run(static_cast<int>(job));
+            finishedJobs.fetch_add(1, std::memory_order_release);
+            ranAny = true;
+        }
+    }
+
+    void startThreads()
+    {
+        for (int i = 0; i < numPrepared; ++i)
+        {
+            auto& worker = *workers[static_cast<size_t>(i)];
+            if (! worker.isThreadRunning() && ! worker.startRealtimeThread(threadOptions))
+                worker.startThread(juce::Thread::Priority::highest);
+        }
+        numRunning.store(numPrepared, std::memory_order_release);
+    }
+
+    // run() stops handing out jobs first, and a worker which is part-way through one finishes it before it exits
+    void stopThreads()
+    {
+        numRunning.store(0, std::memory_order_release);
+        // (stopThread() also wakes a waiting worker, so it sees that it should exit)
+        for (int i = 0; i < maxWorkers; ++i)
+            workers[static_cast<size_t>(i)]->stopThread(1000);
+    }
+
+    struct Worker : juce::Thread
+    {
+        explicit Worker(VoiceWorkerPool& owner)
+            : juce::Thread("ReShimmer voice worker"), pool(owner)
+        {
+        }
+
+        void run() override
+        {
+            auto spinUntil = juce::Time::getHighResolutionTicks() + pool.spinTicks;
+            while (! threadShouldExit())
+            {
+                if (pool.runClaimedJobs())
+                {
+                    spinUntil = juce::Time::getHighResolutionTicks() + pool.spinTicks;
+                }
+                else if (juce::Time::getHighResolutionTicks() < spinUntil)
+                {
+                    std::this_thread::yield();
+                }
+                else
+                {
+                    // the flag goes up before the last look for jobs, so a batch which arrives after that look
+                    // sees the flag and wakes this worker (and if it's missed anyway, run() just does the jobs itself)
+                    waiting.store(true);
+                    if (! pool.hasUnclaimedJobs())
+                        wait(-1);
+                    waiting.store(false);
+                    spinUntil = juce::Time::getHighResolutionTicks() + pool.spinTicks;
+                }
+            }
+        }
+
+        VoiceWorkerPool& pool;
+        std::atomic<bool> waiting { false };
+    };
+    std::vector<std::unique_ptr<Worker>> workers;
+};
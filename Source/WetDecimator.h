@@ -0,0 +1,161 @@
+/*
+  ==============================================================================
+
+    Takes the wet path down to a lower sample rate and back up again, so the
+    stretcher and the reverb don't spend their time on content above 20kHz at
+    high session rates.
+
+    Each 2x step is a rates::Oversampler2xFIR used in reverse: the full-rate
+    signal is written into its (higher-rate) buffer and downsampled out of it,
+    and the processed signal is upsampled back into the same buffer.  Two of
+    them in a row give 4x.
+
+    Host blocks don't have to be a multiple of the factor: samples which don't
+    make up a whole low-rate sample wait for the next block, and the output
+    starts off holding (factor - 1) samples of silence to make up for that.
+
+    It doesn't depend on JUCE, so the benchmarks can use it too.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "stretch/dsp/rates.h"
+
+#include <algorithm>
+#include <vector>
+
+class WetDecimator
+{
+public:
+    // 88.2/96kHz runs the wet path at half the rate, 176.4/192kHz at a quarter, so it always ends up at 44.1/48kHz
+    static int factorForSampleRate(double sampleRate)
+    {
+        if (sampleRate >= 160000.0)
+            return 4;
+        if (sampleRate >= 80000.0)
+            return 2;
+        return 1;
+    }
+
+    // Allocates for blocks of up to `maxBlockSamples` (at the full rate)
+    // (with a factor of 1 there's nothing to do, so don't call down() or up())
+    void prepare(int numChannels, int newFactor, int maxBlockSamples)
+    {
+        factor = newFactor;
+        channels = numChannels;
+        maxBlock = maxBlockSamples;
+
+        int numStages = 0;
+        while ((2 << numStages) <= factor)
+            ++numStages;
+        stages.resize(numStages);
+        // stage s runs between 1/2^s and 1/2^(s+1) of the full rate
+        for (int s = 0; s < numStages; ++s)
+            stages[s].resize(channels, getMaxLowSamples() << (numStages - 1 - s));
+
+        queueStride = maxBlock + 2 * factor;
+        pendingInput.resize(channels * factor);
+        outputQueue.resize(channels * queueStride);
+        reset();
+    }
+
+    void reset()
+    {
+        for (auto& stage : stages)
+            stage.reset();
+        numPending = 0;
+        std::fill(outputQueue.begin(), outputQueue.end(), 0.0f);
+        numQueued = factor - 1;
+    }
+
+    int getFactor() const
+    {
+        return factor;
+    }
+
+    int getMaxBlockSamples() const
+    {
+        return maxBlock;
+    }
+
+    // the most low-rate samples one block can turn into
+    int getMaxLowSamples() const
+    {
+        return (maxBlock + factor - 1) / factor;
+    }
+
+    // Round-trip latency at the full rate: each filter's, plus the wait for a whole low-rate sample
+    int getLatencySamples() const
+    {
+        int latency = factor - 1;
+        for (size_t s = 0; s < stages.size(); ++s)
+            latency += 2 * stages[s].latency() << s;
+        return latency;
+    }
+
+    // Downsamples a block of full-rate input, and returns how many low-rate samples that made
+    int down(const float* const* input, int numSamples, float* const* lowOutput)
+    {
+        const int total = numPending + numSamples;
+        const int lowSamples = total / factor;
+        const int used = lowSamples * factor;
+
+        for (int c = 0; c < channels; ++c)
+        {
+            float* pending = pendingInput.data() + c * factor;
+            const float* channelInput = input[c];
+            if (used == 0)
+            {
+                std::copy(channelInput, channelInput + numSamples, pending + numPending);
+                continue;
+            }
+
+            float* high = stages[0][c];
+            std::copy(pending, pending + numPending, high);
+            std::copy(channelInput, channelInput + used - numPending, high + numPending);
+            std::copy(channelInput + used - numPending, channelInput + numSamples, pending);
+
+            for (size_t s = 0; s < stages.size(); ++s)
+            {
+                float* destination = s + 1 < stages.size() ? stages[s + 1][c] : lowOutput[c];
+                stages[s].downChannel(c, destination, used >> (s + 1));
+            }
+        }
+        numPending = total - used;
+        return lowSamples;
+    }
+
+    // Upsamples what down() returned (after processing) into `numSamples` of full-rate output
+    void up(const float* const* lowInput, int lowSamples, float* const* output, int numSamples)
+    {
+        const int used = lowSamples * factor;
+        for (int c = 0; c < channels; ++c)
+        {
+            for (int s = (int) stages.size() - 1; s >= 0; --s)
+            {
+                const float* source = s + 1 < (int) stages.size() ? stages[s + 1][c] : lowInput[c];
+                stages[s].upChannel(c, source, used >> (s + 1));
+            }
+
+            float* queue = outputQueue.data() + c * queueStride;
+            std::copy(stages[0][c], stages[0][c] + used, queue + numQueued);
+            std::copy(queue, queue + numSamples, output[c]);
+            std::copy(queue + numSamples, queue + numQueued + used, queue);
+        }
+        numQueued += used - numSamples;
+    }
+
+private:
+    int factor = 1, channels = 0, maxBlock = 0;
+    std::vector<signalsmith::rates::Oversampler2xFIR<float>> stages;
+
+    // full-rate input which didn't make up a whole low-rate sample yet
+    std::vector<float> pendingInput;
+    int numPending = 0;
+
+    // full-rate output waiting to go out (never more than factor - 1 samples between blocks)
+    std::vector<float> outputQueue;
+    int queueStride = 0, numQueued = 0;
+};
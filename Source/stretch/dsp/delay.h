@@ -7,6 +7,7 @@
 #include <array>
 #include <cmath> // for std::ceil()
 #include <type_traits>
+#include <algorithm> // for std::fill()
 
 #include <complex>
 #include "./fft.h"
@@ -65,6 +66,12 @@ namespace delay {
 		void reset(Sample value=Sample()) {
 			buffer.assign(buffer.size(), value);
 		}
+		/// Allocates enough for `.resize()` up to this capacity, so that it doesn't allocate later
+		void reserve(int minCapacity) {
+			int bufferLength = 1;
+			while (bufferLength < minCapacity) bufferLength *= 2;
+			buffer.reserve(bufferLength);
+		}
 
 		/// Holds a view for a particular position in the buffer
 		template<bool isConst>
@@ -89,19 +96,48 @@ namespace delay {
 				return buffer->buffer[(bufferIndex + (unsigned)offset)&buffer->bufferMask];
 			}
 
+			/// A range of the buffer as (at most) two contiguous runs of samples, split where it wraps around
+			struct Spans {
+				CSample *first;
+				int firstLength;
+				CSample *second;
+				int secondLength;
+			};
+			/// Returns the samples `[offset, offset + length)` as contiguous spans, so they can be copied in blocks instead of indexing each sample.  `length` can't be more than the buffer's capacity.
+			Spans spans(int offset, int length) const {
+				unsigned start = (bufferIndex + (unsigned)offset)&buffer->bufferMask;
+				int untilEnd = int(buffer->bufferMask + 1 - start);
+				CSample *data = buffer->buffer.data();
+				if (length <= untilEnd) return {data + start, length, data, 0};
+				return {data + start, untilEnd, data, length - untilEnd};
+			}
+
 			/// Write data into the buffer
 			template<typename Data>
 			void write(Data &&data, int length) {
-				for (int i = 0; i < length; ++i) {
-					(*this)[i] = data[i];
-				}
+				Spans s = spans(0, length);
+				for (int i = 0; i < s.firstLength; ++i) s.first[i] = data[i];
+				for (int i = 0; i < s.secondLength; ++i) s.second[i] = data[s.firstLength + i];
+			}
+			/// Add data into the buffer (e.g. for overlap-add)
+			template<typename Data>
+			void add(Data &&data, int length) {
+				Spans s = spans(0, length);
+				for (int i = 0; i < s.firstLength; ++i) s.first[i] += data[i];
+				for (int i = 0; i < s.secondLength; ++i) s.second[i] += data[s.firstLength + i];
+			}
+			/// Fill part of the buffer with a single value
+			void fill(int length, Sample value=Sample()) {
+				Spans s = spans(0, length);
+				std::fill(s.first, s.first + s.firstLength, value);
+				std::fill(s.second, s.second + s.secondLength, value);
 			}
 			/// Read data out from the buffer
 			template<typename Data>
 			void read(int length, Data &&data) const {
-				for (int i = 0; i < length; ++i) {
-					data[i] = (*this)[i];
-				}
+				Spans s = spans(0, length);
+				for (int i = 0; i < s.firstLength; ++i) data[i] = s.first[i];
+				for (int i = 0; i < s.secondLength; ++i) data[s.firstLength + i] = s.second[i];
 			}
 
 			View operator +(int offset) const {
@@ -212,6 +248,9 @@ namespace delay {
 		void reset(Sample value=Sample()) {
 			buffer.reset(value);
 		}
+		void reserve(int nChannels, int capacity) {
+			buffer.reserve(nChannels*capacity);
+		}
 
 		/// A reference-like multi-channel result for a particular sample index
 		template<bool isConst>
@@ -8,6 +8,32 @@
 #include <vector>
 #include <complex>
 #include <cmath>
+#include <type_traits>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <chrono>
+#include <algorithm>
+
+/// Set to 0 to always use the scalar butterflies
+#ifndef SIGNALSMITH_FFT_SIMD
+#	define SIGNALSMITH_FFT_SIMD 1
+#endif
+/** Which plan to use: 0 always permutes then transforms in place, 1 always uses the self-sorting (Stockham) plan, and -1 times both when a size is first used and keeps the faster.
+
+	The two round differently, so timing them makes the output depend on the run.  Timing also makes the first use of each size slow, so only create FFTs off the audio thread (or pin this). */
+#ifndef SIGNALSMITH_FFT_STOCKHAM
+#	define SIGNALSMITH_FFT_STOCKHAM -1
+#endif
+#if SIGNALSMITH_FFT_SIMD
+#	if defined(__AVX2__)
+#		include <immintrin.h>
+#	elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#		include <emmintrin.h>
+#	elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#		include <arm_neon.h>
+#	endif
+#endif
 
 namespace signalsmith { namespace fft {
 	/**	@defgroup FFT FFT (complex and real)
@@ -68,6 +94,251 @@ namespace signalsmith { namespace fft {
 				return std::begin(t);
 			}
 		};
+
+		/* A process-wide cache of read-only tables.  Entries are reference-counted, and kept for as long as something is using them.
+
+		New entries are created without holding the lock (creating a plan can mean timing it), so other sizes aren't held up.  If two threads create the same entry at once, the first one stored is used by both. */
+		template<typename Key, typename Value>
+		class SharedCache {
+			std::mutex mutex;
+			std::map<Key, std::weak_ptr<const Value>> entries;
+
+			std::shared_ptr<const Value> find(const Key &key) {
+				auto iter = entries.find(key);
+				if (iter != entries.end()) return iter->second.lock();
+				return nullptr;
+			}
+		public:
+			template<class CreateFn>
+			std::shared_ptr<const Value> get(const Key &key, CreateFn &&create) {
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					std::shared_ptr<const Value> existing = find(key);
+					if (existing) return existing;
+				}
+				std::shared_ptr<const Value> value = create();
+
+				std::lock_guard<std::mutex> lock(mutex);
+				std::shared_ptr<const Value> existing = find(key);
+				if (existing) return existing;
+				// Clear out anything which is no longer used
+				for (auto iter = entries.begin(); iter != entries.end();) {
+					if (iter->second.expired()) {
+						iter = entries.erase(iter);
+					} else {
+						++iter;
+					}
+				}
+				entries[key] = value;
+				return value;
+			}
+		};
+
+		/* SIMD operations on split real/imaginary lanes.
+		`loadComplex()`/`storeComplex()` convert between `width` interleaved `std::complex<V>`s and a pair of vectors, and `load()`/`store()` read/write `width` consecutive (split) values. */
+		template<typename V>
+		struct SplitSimd {
+			static constexpr bool enabled = false;
+			static constexpr size_t width = 1;
+		};
+#if SIGNALSMITH_FFT_SIMD && defined(__AVX2__)
+		template<>
+		struct SplitSimd<float> {
+			static constexpr bool enabled = true;
+			static constexpr size_t width = 8;
+			using Vec = __m256;
+			static SIGNALSMITH_INLINE Vec load(const float *v) {
+				return _mm256_loadu_ps(v);
+			}
+			static SIGNALSMITH_INLINE void store(float *v, Vec value) {
+				_mm256_storeu_ps(v, value);
+			}
+			static SIGNALSMITH_INLINE void loadComplex(const std::complex<float> *c, Vec &real, Vec &imag) {
+				Vec a = _mm256_loadu_ps((const float *)c), b = _mm256_loadu_ps((const float *)(c + 4));
+				// [r0 r1 r4 r5 | r2 r3 r6 r7], then swap the middle pairs
+				Vec r = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), i = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+				real = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(r), _MM_SHUFFLE(3, 1, 2, 0)));
+				imag = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(i), _MM_SHUFFLE(3, 1, 2, 0)));
+			}
+			static SIGNALSMITH_INLINE void storeComplex(std::complex<float> *c, Vec real, Vec imag) {
+				Vec r = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(real), _MM_SHUFFLE(3, 1, 2, 0)));
+				Vec i = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(imag), _MM_SHUFFLE(3, 1, 2, 0)));
+				_mm256_storeu_ps((float *)c, _mm256_unpacklo_ps(r, i));
+				_mm256_storeu_ps((float *)(c + 4), _mm256_unpackhi_ps(r, i));
+			}
+			static SIGNALSMITH_INLINE Vec set(float v) {
+				return _mm256_set1_ps(v);
+			}
+			static SIGNALSMITH_INLINE Vec add(Vec a, Vec b) {
+				return _mm256_add_ps(a, b);
+			}
+			static SIGNALSMITH_INLINE Vec sub(Vec a, Vec b) {
+				return _mm256_sub_ps(a, b);
+			}
+			static SIGNALSMITH_INLINE Vec mul(Vec a, Vec b) {
+				return _mm256_mul_ps(a, b);
+			}
+		};
+#elif SIGNALSMITH_FFT_SIMD && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+		template<>
+		struct SplitSimd<float> {
+			static constexpr bool enabled = true;
+			static constexpr size_t width = 4;
+			using Vec = __m128;
+			static SIGNALSMITH_INLINE Vec load(const float *v) {
+				return _mm_loadu_ps(v);
+			}
+			static SIGNALSMITH_INLINE void store(float *v, Vec value) {
+				_mm_storeu_ps(v, value);
+			}
+			static SIGNALSMITH_INLINE void loadComplex(const std::complex<float> *c, Vec &real, Vec &imag) {
+				Vec a = _mm_loadu_ps((const float *)c), b = _mm_loadu_ps((const float *)(c + 2));
+				real = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+				imag = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+			}
+			static SIGNALSMITH_INLINE void storeComplex(std::complex<float> *c, Vec real, Vec imag) {
+				_mm_storeu_ps((float *)c, _mm_unpacklo_ps(real, imag));
+				_mm_storeu_ps((float *)(c + 2), _mm_unpackhi_ps(real, imag));
+			}
+			static SIGNALSMITH_INLINE Vec set(float v) {
+				return _mm_set1_ps(v);
+			}
+			static SIGNALSMITH_INLINE Vec add(Vec a, Vec b) {
+				return _mm_add_ps(a, b);
+			}
+			static SIGNALSMITH_INLINE Vec sub(Vec a, Vec b) {
+				return _mm_sub_ps(a, b);
+			}
+			static SIGNALSMITH_INLINE Vec mul(Vec a, Vec b) {
+				return _mm_mul_ps(a, b);
+			}
+		};
+#elif SIGNALSMITH_FFT_SIMD && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+		template<>
+		struct SplitSimd<float> {
+			static constexpr bool enabled = true;
+			static constexpr size_t width = 4;
+			using Vec = float32x4_t;
+			static SIGNALSMITH_INLINE Vec load(const float *v) {
+				return vld1q_f32(v);
+			}
+			static SIGNALSMITH_INLINE void store(float *v, Vec value) {
+				vst1q_f32(v, value);
+			}
+			static SIGNALSMITH_INLINE void loadComplex(const std::complex<float> *c, Vec &real, Vec &imag) {
+				float32x4x2_t pair = vld2q_f32((const float *)c);
+				real = pair.val[0];
+				imag = pair.val[1];
+			}
+			static SIGNALSMITH_INLINE void storeComplex(std::complex<float> *c, Vec real, Vec imag) {
+				float32x4x2_t pair = {{real, imag}};
+				vst2q_f32((float *)c, pair);
+			}
+			static SIGNALSMITH_INLINE Vec set(float v) {
+				return vdupq_n_f32(v);
+			}
+			static SIGNALSMITH_INLINE Vec add(Vec a, Vec b) {
+				return vaddq_f32(a, b);
+			}
+			static SIGNALSMITH_INLINE Vec sub(Vec a, Vec b) {
+				return vsubq_f32(a, b);
+			}
+			static SIGNALSMITH_INLINE Vec mul(Vec a, Vec b) {
+				return vmulq_f32(a, b);
+			}
+		};
+#endif
+#if SIGNALSMITH_FFT_SIMD && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+		template<>
+		struct SplitSimd<double> {
+			static constexpr bool enabled = true;
+			static constexpr size_t width = 2;
+			using Vec = __m128d;
+			static SIGNALSMITH_INLINE Vec load(const double *v) {
+				return _mm_loadu_pd(v);
+			}
+			static SIGNALSMITH_INLINE void store(double *v, Vec value) {
+				_mm_storeu_pd(v, value);
+			}
+			static SIGNALSMITH_INLINE void loadComplex(const std::complex<double> *c, Vec &real, Vec &imag) {
+				Vec a = _mm_loadu_pd((const double *)c), b = _mm_loadu_pd((const double *)(c + 1));
+				real = _mm_unpacklo_pd(a, b);
+				imag = _mm_unpackhi_pd(a, b);
+			}
+			static SIGNALSMITH_INLINE void storeComplex(std::complex<double> *c, Vec real, Vec imag) {
+				_mm_storeu_pd((double *)c, _mm_unpacklo_pd(real, imag));
+				_mm_storeu_pd((double *)(c + 1), _mm_unpackhi_pd(real, imag));
+			}
+			static SIGNALSMITH_INLINE Vec set(double v) {
+				return _mm_set1_pd(v);
+			}
+			static SIGNALSMITH_INLINE Vec add(Vec a, Vec b) {
+				return _mm_add_pd(a, b);
+			}
+			static SIGNALSMITH_INLINE Vec sub(Vec a, Vec b) {
+				return _mm_sub_pd(a, b);
+			}
+			static SIGNALSMITH_INLINE Vec mul(Vec a, Vec b) {
+				return _mm_mul_pd(a, b);
+			}
+		};
+#elif SIGNALSMITH_FFT_SIMD && defined(__aarch64__)
+		template<>
+		struct SplitSimd<double> {
+			static constexpr bool enabled = true;
+			static constexpr size_t width = 2;
+			using Vec = float64x2_t;
+			static SIGNALSMITH_INLINE Vec load(const double *v) {
+				return vld1q_f64(v);
+			}
+			static SIGNALSMITH_INLINE void store(double *v, Vec value) {
+				vst1q_f64(v, value);
+			}
+			static SIGNALSMITH_INLINE void loadComplex(const std::complex<double> *c, Vec &real, Vec &imag) {
+				float64x2x2_t pair = vld2q_f64((const double *)c);
+				real = pair.val[0];
+				imag = pair.val[1];
+			}
+			static SIGNALSMITH_INLINE void storeComplex(std::complex<double> *c, Vec real, Vec imag) {
+				float64x2x2_t pair = {{real, imag}};
+				vst2q_f64((double *)c, pair);
+			}
+			static SIGNALSMITH_INLINE Vec set(double v) {
+				return vdupq_n_f64(v);
+			}
+			static SIGNALSMITH_INLINE Vec add(Vec a, Vec b) {
+				return vaddq_f64(a, b);
+			}
+			static SIGNALSMITH_INLINE Vec sub(Vec a, Vec b) {
+				return vsubq_f64(a, b);
+			}
+			static SIGNALSMITH_INLINE Vec mul(Vec a, Vec b) {
+				return vmulq_f64(a, b);
+			}
+		};
+#endif
+
+		// Split versions of `complexMul()` and `complexAddI()`
+		template<bool conjugateSecond, class Simd, class Vec>
+		SIGNALSMITH_INLINE void splitMul(Vec aReal, Vec aImag, Vec bReal, Vec bImag, Vec &real, Vec &imag) {
+			if (conjugateSecond) {
+				real = Simd::add(Simd::mul(bReal, aReal), Simd::mul(bImag, aImag));
+				imag = Simd::sub(Simd::mul(bReal, aImag), Simd::mul(bImag, aReal));
+			} else {
+				real = Simd::sub(Simd::mul(aReal, bReal), Simd::mul(aImag, bImag));
+				imag = Simd::add(Simd::mul(aReal, bImag), Simd::mul(aImag, bReal));
+			}
+		}
+		template<bool flipped, class Simd, class Vec>
+		SIGNALSMITH_INLINE void splitAddI(Vec aReal, Vec aImag, Vec bReal, Vec bImag, Vec &real, Vec &imag) {
+			if (flipped) {
+				real = Simd::add(aReal, bImag);
+				imag = Simd::sub(aImag, bReal);
+			} else {
+				real = Simd::sub(aReal, bImag);
+				imag = Simd::add(aImag, bReal);
+			}
+		}
 	}
 
 	/** Floating-point FFT implementation.
@@ -80,6 +351,8 @@ namespace signalsmith { namespace fft {
 		using complex = std::complex<V>;
 		size_t _size;
 		std::vector<complex> workingVector;
+		// The other half of the ping-pong for Stockham plans
+		std::vector<complex> stockhamVector;
 		
 		enum class StepType {
 			generic, step2, step3, step4
@@ -92,106 +365,161 @@ namespace signalsmith { namespace fft {
 			size_t outerRepeats;
 			size_t twiddleIndex;
 		};
-		std::vector<size_t> factors;
-		std::vector<Step> plan;
-		std::vector<complex> twiddleVector;
+		/* A self-sorting (Stockham) stage: `radix`-point DFTs combine sub-transforms of length `subSize` (the product of the earlier radices) into ones `radix` times longer.
+		It reads each input in natural order and writes its output in natural order too (to the other buffer), so there's no permutation pass. */
+		struct StockhamStage {
+			size_t radix;
+			size_t subSize;
+			size_t twiddleIndex;
+		};
+		// The factorisation, steps and tables for a particular size.  These don't change once they're created, so they're shared between all FFTs of the same size and type.
+		struct Plan {
+			size_t size;
+			bool stockham;
+			std::vector<StockhamStage> stockhamStages;
+			// For each stage, runs of `subSize` real then imaginary parts for each of the radix's non-trivial twiddles
+			std::vector<V> stockhamTwiddles;
+
+			std::vector<size_t> factors;
+			std::vector<Step> steps;
+			std::vector<complex> twiddleVector;
+			// The same twiddles (starting at `2*twiddleIndex`), but as separate real/imaginary runs for each factor
+			std::vector<V> splitTwiddles;
 		
-		struct PermutationPair {size_t from, to;};
-		std::vector<PermutationPair> permutation;
+			struct PermutationPair {size_t from, to;};
+			std::vector<PermutationPair> permutation;
 		
-		void addPlanSteps(size_t factorIndex, size_t start, size_t length, size_t repeats) {
-			if (factorIndex >= factors.size()) return;
+			void addPlanSteps(size_t factorIndex, size_t start, size_t length, size_t repeats) {
+				if (factorIndex >= factors.size()) return;
 			
-			size_t factor = factors[factorIndex];
-			if (factorIndex + 1 < factors.size()) {
-				if (factors[factorIndex] == 2 && factors[factorIndex + 1] == 2) {
-					++factorIndex;
-					factor = 4;
+				size_t factor = factors[factorIndex];
+				if (factorIndex + 1 < factors.size()) {
+					if (factors[factorIndex] == 2 && factors[factorIndex + 1] == 2) {
+						++factorIndex;
+						factor = 4;
+					}
 				}
-			}
 
-			size_t subLength = length/factor;
-			Step mainStep{StepType::generic, factor, start, subLength, repeats, twiddleVector.size()};
+				size_t subLength = length/factor;
+				Step mainStep{StepType::generic, factor, start, subLength, repeats, twiddleVector.size()};
 
-			if (factor == 2) mainStep.type = StepType::step2;
-			if (factor == 3) mainStep.type = StepType::step3;
-			if (factor == 4) mainStep.type = StepType::step4;
+				if (factor == 2) mainStep.type = StepType::step2;
+				if (factor == 3) mainStep.type = StepType::step3;
+				if (factor == 4) mainStep.type = StepType::step4;
 
-			// Twiddles
-			bool foundStep = false;
-			for (const Step &existingStep : plan) {
-				if (existingStep.factor == mainStep.factor && existingStep.innerRepeats == mainStep.innerRepeats) {
-					foundStep = true;
-					mainStep.twiddleIndex = existingStep.twiddleIndex;
-					break;
+				// Twiddles
+				bool foundStep = false;
+				for (const Step &existingStep : steps) {
+					if (existingStep.factor == mainStep.factor && existingStep.innerRepeats == mainStep.innerRepeats) {
+						foundStep = true;
+						mainStep.twiddleIndex = existingStep.twiddleIndex;
+						break;
+					}
+				}
+				if (!foundStep) {
+					for (size_t i = 0; i < subLength; ++i) {
+						for (size_t f = 0; f < factor; ++f) {
+							double phase = 2*M_PI*i*f/length;
+							complex twiddle = {V(std::cos(phase)), V(-std::sin(phase))};
+							twiddleVector.push_back(twiddle);
+						}
+					}
+				}
+
+				if (repeats == 1 && sizeof(complex)*subLength > 65536) {
+					for (size_t i = 0; i < factor; ++i) {
+						addPlanSteps(factorIndex + 1, start + i*subLength, subLength, 1);
+					}
+				} else {
+					addPlanSteps(factorIndex + 1, start, subLength, repeats*factor);
 				}
+				steps.push_back(mainStep);
 			}
-			if (!foundStep) {
-				for (size_t i = 0; i < subLength; ++i) {
-					for (size_t f = 0; f < factor; ++f) {
-						double phase = 2*M_PI*i*f/length;
-						complex twiddle = {V(std::cos(phase)), V(-std::sin(phase))};
-						twiddleVector.push_back(twiddle);
+			void addStockhamStages() {
+				size_t subSize = 1;
+				for (size_t i = 0; i < factors.size(); ++i) {
+					size_t radix = factors[i];
+					if (radix == 2 && i + 1 < factors.size() && factors[i + 1] == 2) {
+						radix = 4;
+						++i;
+					}
+					stockhamStages.push_back({radix, subSize, stockhamTwiddles.size()});
+					for (size_t r = 1; r < radix; ++r) {
+						for (size_t k = 0; k < subSize; ++k) {
+							double phase = 2*M_PI*k*r/(subSize*radix);
+							stockhamTwiddles.push_back(V(std::cos(phase)));
+						}
+						for (size_t k = 0; k < subSize; ++k) {
+							double phase = 2*M_PI*k*r/(subSize*radix);
+							stockhamTwiddles.push_back(V(-std::sin(phase)));
+						}
 					}
+					subSize *= radix;
 				}
 			}
 
-			if (repeats == 1 && sizeof(complex)*subLength > 65536) {
-				for (size_t i = 0; i < factor; ++i) {
-					addPlanSteps(factorIndex + 1, start + i*subLength, subLength, 1);
+			Plan(size_t _size, bool useStockham=false) : size(_size), stockham(useStockham) {
+				size_t size = _size, factor = 2;
+				while (size > 1) {
+					if (size%factor == 0) {
+						factors.push_back(factor);
+						size /= factor;
+					} else if (factor > sqrt(size)) {
+						factor = size;
+					} else {
+						++factor;
+					}
 				}
-			} else {
-				addPlanSteps(factorIndex + 1, start, subLength, repeats*factor);
-			}
-			plan.push_back(mainStep);
-		}
-		void setPlan() {
-			factors.resize(0);
-			size_t size = _size, factor = 2;
-			while (size > 1) {
-				if (size%factor == 0) {
-					factors.push_back(factor);
-					size /= factor;
-				} else if (factor > sqrt(size)) {
-					factor = size;
-				} else {
-					++factor;
+
+				if (stockham) {
+					addStockhamStages();
+					return;
 				}
-			}
 
-			plan.resize(0);
-			twiddleVector.resize(0);
-			addPlanSteps(0, 0, _size, 1);
-			
-			permutation.resize(0);
-			permutation.push_back(PermutationPair{0, 0});
-			size_t indexLow = 0, indexHigh = factors.size();
-			size_t inputStepLow = _size, outputStepLow = 1;
-			size_t inputStepHigh = 1, outputStepHigh = _size;
-			while (outputStepLow*inputStepHigh < _size) {
-				size_t f, inputStep, outputStep;
-				if (outputStepLow <= inputStepHigh) {
-					f = factors[indexLow++];
-					inputStep = (inputStepLow /= f);
-					outputStep = outputStepLow;
-					outputStepLow *= f;
-				} else {
-					f = factors[--indexHigh];
-					inputStep = inputStepHigh;
-					inputStepHigh *= f;
-					outputStep = (outputStepHigh /= f);
+				addPlanSteps(0, 0, _size, 1);
+
+				splitTwiddles.resize(twiddleVector.size()*2);
+				for (const Step &step : steps) {
+					const complex *twiddles = twiddleVector.data() + step.twiddleIndex;
+					V *split = splitTwiddles.data() + 2*step.twiddleIndex;
+					for (size_t i = 0; i < step.innerRepeats; ++i) {
+						for (size_t f = 0; f < step.factor; ++f) {
+							split[2*f*step.innerRepeats + i] = twiddles[i*step.factor + f].real();
+							split[(2*f + 1)*step.innerRepeats + i] = twiddles[i*step.factor + f].imag();
+						}
+					}
 				}
-				size_t oldSize = permutation.size();
-				for (size_t i = 1; i < f; ++i) {
-					for (size_t j = 0; j < oldSize; ++j) {
-						PermutationPair pair = permutation[j];
-						pair.from += i*inputStep;
-						pair.to += i*outputStep;
-						permutation.push_back(pair);
+			
+				permutation.push_back(PermutationPair{0, 0});
+				size_t indexLow = 0, indexHigh = factors.size();
+				size_t inputStepLow = _size, outputStepLow = 1;
+				size_t inputStepHigh = 1, outputStepHigh = _size;
+				while (outputStepLow*inputStepHigh < _size) {
+					size_t f, inputStep, outputStep;
+					if (outputStepLow <= inputStepHigh) {
+						f = factors[indexLow++];
+						inputStep = (inputStepLow /= f);
+						outputStep = outputStepLow;
+						outputStepLow *= f;
+					} else {
+						f = factors[--indexHigh];
+						inputStep = inputStepHigh;
+						inputStepHigh *= f;
+						outputStep = (outputStepHigh /= f);
+					}
+					size_t oldSize = permutation.size();
+					for (size_t i = 1; i < f; ++i) {
+						for (size_t j = 0; j < oldSize; ++j) {
+							PermutationPair pair = permutation[j];
+							pair.from += i*inputStep;
+							pair.to += i*outputStep;
+							permutation.push_back(pair);
+						}
 					}
 				}
 			}
-		}
+		};
+		std::shared_ptr<const Plan> plan;
 
 		template<bool inverse, typename RandomAccessIterator>
 		void fftStepGeneric(RandomAccessIterator &&origData, const Step &step) {
@@ -201,7 +529,7 @@ namespace signalsmith { namespace fft {
 			for (size_t outerRepeat = 0; outerRepeat < step.outerRepeats; ++outerRepeat) {
 				RandomAccessIterator data = origData;
 				
-				const complex *twiddles = twiddleVector.data() + step.twiddleIndex;
+				const complex *twiddles = plan->twiddleVector.data() + step.twiddleIndex;
 				const size_t factor = step.factor;
 				for (size_t repeat = 0; repeat < step.innerRepeats; ++repeat) {
 					for (size_t i = 0; i < step.factor; ++i) {
@@ -223,18 +551,22 @@ namespace signalsmith { namespace fft {
 			}
 		}
 
+		template<bool inverse, typename RandomAccessIterator>
+		SIGNALSMITH_INLINE void butterfly2(RandomAccessIterator data, size_t stride, const complex *twiddles) {
+			complex A = data[0];
+			complex B = _fft_impl::complexMul<inverse>(data[stride], twiddles[1]);
+			
+			data[0] = A + B;
+			data[stride] = A - B;
+		}
 		template<bool inverse, typename RandomAccessIterator>
 		SIGNALSMITH_INLINE void fftStep2(RandomAccessIterator &&origData, const Step &step) {
 			const size_t stride = step.innerRepeats;
-			const complex *origTwiddles = twiddleVector.data() + step.twiddleIndex;
+			const complex *origTwiddles = plan->twiddleVector.data() + step.twiddleIndex;
 			for (size_t outerRepeat = 0; outerRepeat < step.outerRepeats; ++outerRepeat) {
 				const complex* twiddles = origTwiddles;
 				for (RandomAccessIterator data = origData; data < origData + stride; ++data) {
-					complex A = data[0];
-					complex B = _fft_impl::complexMul<inverse>(data[stride], twiddles[1]);
-					
-					data[0] = A + B;
-					data[stride] = A - B;
+					butterfly2<inverse>(data, stride, twiddles);
 					twiddles += 2;
 				}
 				origData += 2*stride;
@@ -242,85 +574,431 @@ namespace signalsmith { namespace fft {
 		}
 
 		template<bool inverse, typename RandomAccessIterator>
-		SIGNALSMITH_INLINE void fftStep3(RandomAccessIterator &&origData, const Step &step) {
+		SIGNALSMITH_INLINE void butterfly3(RandomAccessIterator data, size_t stride, const complex *twiddles) {
 			constexpr complex factor3 = {-0.5, inverse ? 0.8660254037844386 : -0.8660254037844386};
+			complex A = data[0];
+			complex B = _fft_impl::complexMul<inverse>(data[stride], twiddles[1]);
+			complex C = _fft_impl::complexMul<inverse>(data[stride*2], twiddles[2]);
+			
+			complex realSum = A + (B + C)*factor3.real();
+			complex imagSum = (B - C)*factor3.imag();
+
+			data[0] = A + B + C;
+			data[stride] = _fft_impl::complexAddI<false>(realSum, imagSum);
+			data[stride*2] = _fft_impl::complexAddI<true>(realSum, imagSum);
+		}
+		template<bool inverse, typename RandomAccessIterator>
+		SIGNALSMITH_INLINE void fftStep3(RandomAccessIterator &&origData, const Step &step) {
 			const size_t stride = step.innerRepeats;
-			const complex *origTwiddles = twiddleVector.data() + step.twiddleIndex;
+			const complex *origTwiddles = plan->twiddleVector.data() + step.twiddleIndex;
 			
 			for (size_t outerRepeat = 0; outerRepeat < step.outerRepeats; ++outerRepeat) {
 				const complex* twiddles = origTwiddles;
 				for (RandomAccessIterator data = origData; data < origData + stride; ++data) {
-					complex A = data[0];
-					complex B = _fft_impl::complexMul<inverse>(data[stride], twiddles[1]);
-					complex C = _fft_impl::complexMul<inverse>(data[stride*2], twiddles[2]);
-					
-					complex realSum = A + (B + C)*factor3.real();
-					complex imagSum = (B - C)*factor3.imag();
-
-					data[0] = A + B + C;
-					data[stride] = _fft_impl::complexAddI<false>(realSum, imagSum);
-					data[stride*2] = _fft_impl::complexAddI<true>(realSum, imagSum);
-
+					butterfly3<inverse>(data, stride, twiddles);
 					twiddles += 3;
 				}
 				origData += 3*stride;
 			}
 		}
 
+		template<bool inverse, typename RandomAccessIterator>
+		SIGNALSMITH_INLINE void butterfly4(RandomAccessIterator data, size_t stride, const complex *twiddles) {
+			complex A = data[0];
+			complex C = _fft_impl::complexMul<inverse>(data[stride], twiddles[2]);
+			complex B = _fft_impl::complexMul<inverse>(data[stride*2], twiddles[1]);
+			complex D = _fft_impl::complexMul<inverse>(data[stride*3], twiddles[3]);
+
+			complex sumAC = A + C, sumBD = B + D;
+			complex diffAC = A - C, diffBD = B - D;
+
+			data[0] = sumAC + sumBD;
+			data[stride] = _fft_impl::complexAddI<!inverse>(diffAC, diffBD);
+			data[stride*2] = sumAC - sumBD;
+			data[stride*3] = _fft_impl::complexAddI<inverse>(diffAC, diffBD);
+		}
 		template<bool inverse, typename RandomAccessIterator>
 		SIGNALSMITH_INLINE void fftStep4(RandomAccessIterator &&origData, const Step &step) {
 			const size_t stride = step.innerRepeats;
-			const complex *origTwiddles = twiddleVector.data() + step.twiddleIndex;
+			const complex *origTwiddles = plan->twiddleVector.data() + step.twiddleIndex;
 			
 			for (size_t outerRepeat = 0; outerRepeat < step.outerRepeats; ++outerRepeat) {
 				const complex* twiddles = origTwiddles;
 				for (RandomAccessIterator data = origData; data < origData + stride; ++data) {
-					complex A = data[0];
-					complex C = _fft_impl::complexMul<inverse>(data[stride], twiddles[2]);
-					complex B = _fft_impl::complexMul<inverse>(data[stride*2], twiddles[1]);
-					complex D = _fft_impl::complexMul<inverse>(data[stride*3], twiddles[3]);
+					butterfly4<inverse>(data, stride, twiddles);
+					twiddles += 4;
+				}
+				origData += 4*stride;
+			}
+		}
 
-					complex sumAC = A + C, sumBD = B + D;
-					complex diffAC = A - C, diffBD = B - D;
+		/* SIMD butterflies, for contiguous data.  These do `Simd::width` butterflies at once (using the split twiddles), and finish off any remainder with the scalar ones above. */
+		using Simd = _fft_impl::SplitSimd<V>;
 
-					data[0] = sumAC + sumBD;
-					data[stride] = _fft_impl::complexAddI<!inverse>(diffAC, diffBD);
-					data[stride*2] = sumAC - sumBD;
-					data[stride*3] = _fft_impl::complexAddI<inverse>(diffAC, diffBD);
+		template<bool inverse>
+		void fftStep2Split(complex *origData, const Step &step) {
+			using Vec = typename Simd::Vec;
+			const size_t stride = step.innerRepeats;
+			const complex *origTwiddles = plan->twiddleVector.data() + step.twiddleIndex;
+			const V *split = plan->splitTwiddles.data() + 2*step.twiddleIndex;
+			const V *split1Real = split + 2*stride, *split1Imag = split + 3*stride;
 
-					twiddles += 4;
+			for (size_t outerRepeat = 0; outerRepeat < step.outerRepeats; ++outerRepeat) {
+				size_t i = 0;
+				for (; i + Simd::width <= stride; i += Simd::width) {
+					complex *data = origData + i;
+					Vec aReal, aImag, bReal, bImag;
+					Simd::loadComplex(data, aReal, aImag);
+					Simd::loadComplex(data + stride, bReal, bImag);
+					_fft_impl::splitMul<inverse, Simd>(bReal, bImag, Simd::load(split1Real + i), Simd::load(split1Imag + i), bReal, bImag);
+
+					Simd::storeComplex(data, Simd::add(aReal, bReal), Simd::add(aImag, bImag));
+					Simd::storeComplex(data + stride, Simd::sub(aReal, bReal), Simd::sub(aImag, bImag));
+				}
+				for (; i < stride; ++i) {
+					butterfly2<inverse>(origData + i, stride, origTwiddles + 2*i);
+				}
+				origData += 2*stride;
+			}
+		}
+
+		template<bool inverse>
+		void fftStep3Split(complex *origData, const Step &step) {
+			using Vec = typename Simd::Vec;
+			const Vec factor3Real = Simd::set(-0.5), factor3Imag = Simd::set(inverse ? 0.8660254037844386 : -0.8660254037844386);
+			const size_t stride = step.innerRepeats;
+			const complex *origTwiddles = plan->twiddleVector.data() + step.twiddleIndex;
+			const V *split = plan->splitTwiddles.data() + 2*step.twiddleIndex;
+			const V *split1Real = split + 2*stride, *split1Imag = split + 3*stride;
+			const V *split2Real = split + 4*stride, *split2Imag = split + 5*stride;
+
+			for (size_t outerRepeat = 0; outerRepeat < step.outerRepeats; ++outerRepeat) {
+				size_t i = 0;
+				for (; i + Simd::width <= stride; i += Simd::width) {
+					complex *data = origData + i;
+					Vec aReal, aImag, bReal, bImag, cReal, cImag;
+					Simd::loadComplex(data, aReal, aImag);
+					Simd::loadComplex(data + stride, bReal, bImag);
+					Simd::loadComplex(data + stride*2, cReal, cImag);
+					_fft_impl::splitMul<inverse, Simd>(bReal, bImag, Simd::load(split1Real + i), Simd::load(split1Imag + i), bReal, bImag);
+					_fft_impl::splitMul<inverse, Simd>(cReal, cImag, Simd::load(split2Real + i), Simd::load(split2Imag + i), cReal, cImag);
+
+					Vec realSumReal = Simd::add(aReal, Simd::mul(Simd::add(bReal, cReal), factor3Real));
+					Vec realSumImag = Simd::add(aImag, Simd::mul(Simd::add(bImag, cImag), factor3Real));
+					Vec imagSumReal = Simd::mul(Simd::sub(bReal, cReal), factor3Imag);
+					Vec imagSumImag = Simd::mul(Simd::sub(bImag, cImag), factor3Imag);
+
+					Vec outReal, outImag;
+					Simd::storeComplex(data, Simd::add(Simd::add(aReal, bReal), cReal), Simd::add(Simd::add(aImag, bImag), cImag));
+					_fft_impl::splitAddI<false, Simd>(realSumReal, realSumImag, imagSumReal, imagSumImag, outReal, outImag);
+					Simd::storeComplex(data + stride, outReal, outImag);
+					_fft_impl::splitAddI<true, Simd>(realSumReal, realSumImag, imagSumReal, imagSumImag, outReal, outImag);
+					Simd::storeComplex(data + stride*2, outReal, outImag);
+				}
+				for (; i < stride; ++i) {
+					butterfly3<inverse>(origData + i, stride, origTwiddles + 3*i);
+				}
+				origData += 3*stride;
+			}
+		}
+
+		template<bool inverse>
+		void fftStep4Split(complex *origData, const Step &step) {
+			using Vec = typename Simd::Vec;
+			const size_t stride = step.innerRepeats;
+			const complex *origTwiddles = plan->twiddleVector.data() + step.twiddleIndex;
+			const V *split = plan->splitTwiddles.data() + 2*step.twiddleIndex;
+			const V *split1Real = split + 2*stride, *split1Imag = split + 3*stride;
+			const V *split2Real = split + 4*stride, *split2Imag = split + 5*stride;
+			const V *split3Real = split + 6*stride, *split3Imag = split + 7*stride;
+
+			for (size_t outerRepeat = 0; outerRepeat < step.outerRepeats; ++outerRepeat) {
+				size_t i = 0;
+				for (; i + Simd::width <= stride; i += Simd::width) {
+					complex *data = origData + i;
+					Vec aReal, aImag, bReal, bImag, cReal, cImag, dReal, dImag;
+					Simd::loadComplex(data, aReal, aImag);
+					Simd::loadComplex(data + stride, cReal, cImag);
+					Simd::loadComplex(data + stride*2, bReal, bImag);
+					Simd::loadComplex(data + stride*3, dReal, dImag);
+					_fft_impl::splitMul<inverse, Simd>(cReal, cImag, Simd::load(split2Real + i), Simd::load(split2Imag + i), cReal, cImag);
+					_fft_impl::splitMul<inverse, Simd>(bReal, bImag, Simd::load(split1Real + i), Simd::load(split1Imag + i), bReal, bImag);
+					_fft_impl::splitMul<inverse, Simd>(dReal, dImag, Simd::load(split3Real + i), Simd::load(split3Imag + i), dReal, dImag);
+
+					Vec sumACReal = Simd::add(aReal, cReal), sumACImag = Simd::add(aImag, cImag);
+					Vec sumBDReal = Simd::add(bReal, dReal), sumBDImag = Simd::add(bImag, dImag);
+					Vec diffACReal = Simd::sub(aReal, cReal), diffACImag = Simd::sub(aImag, cImag);
+					Vec diffBDReal = Simd::sub(bReal, dReal), diffBDImag = Simd::sub(bImag, dImag);
+
+					Vec outReal, outImag;
+					Simd::storeComplex(data, Simd::add(sumACReal, sumBDReal), Simd::add(sumACImag, sumBDImag));
+					_fft_impl::splitAddI<!inverse, Simd>(diffACReal, diffACImag, diffBDReal, diffBDImag, outReal, outImag);
+					Simd::storeComplex(data + stride, outReal, outImag);
+					Simd::storeComplex(data + stride*2, Simd::sub(sumACReal, sumBDReal), Simd::sub(sumACImag, sumBDImag));
+					_fft_impl::splitAddI<inverse, Simd>(diffACReal, diffACImag, diffBDReal, diffBDImag, outReal, outImag);
+					Simd::storeComplex(data + stride*3, outReal, outImag);
+				}
+				for (; i < stride; ++i) {
+					butterfly4<inverse>(origData + i, stride, origTwiddles + 4*i);
 				}
 				origData += 4*stride;
 			}
 		}
-		
+
 		template<typename InputIterator, typename OutputIterator>
 		void permute(InputIterator input, OutputIterator data) {
-			for (auto pair : permutation) {
+			for (auto pair : plan->permutation) {
 				data[pair.from] = input[pair.to];
 			}
 		}
 
+		template<bool inverse, typename OutputIterator>
+		void runStep(OutputIterator &&data, const Step &step) {
+			runStepAt<inverse>(data, step);
+		}
+		// Contiguous data can use the SIMD butterflies
+		template<bool inverse>
+		void runStepAt(complex *data, const Step &step) {
+			runStepContiguous<inverse>(data, step, std::integral_constant<bool, Simd::enabled>{});
+		}
+		template<bool inverse>
+		void runStepContiguous(complex *data, const Step &step, std::false_type) {
+			runStepScalar<inverse>(data, step);
+		}
+		template<bool inverse>
+		void runStepContiguous(complex *data, const Step &step, std::true_type) {
+			if (step.innerRepeats < Simd::width) return runStepScalar<inverse>(data, step);
+			switch (step.type) {
+				case StepType::generic:
+					fftStepGeneric<inverse>(data + step.startIndex, step);
+					break;
+				case StepType::step2:
+					fftStep2Split<inverse>(data + step.startIndex, step);
+					break;
+				case StepType::step3:
+					fftStep3Split<inverse>(data + step.startIndex, step);
+					break;
+				case StepType::step4:
+					fftStep4Split<inverse>(data + step.startIndex, step);
+					break;
+			}
+		}
+		template<bool inverse, typename RandomAccessIterator>
+		void runStepAt(RandomAccessIterator data, const Step &step) {
+			runStepScalar<inverse>(data, step);
+		}
+		template<bool inverse, typename RandomAccessIterator>
+		void runStepScalar(RandomAccessIterator data, const Step &step) {
+			switch (step.type) {
+				case StepType::generic:
+					fftStepGeneric<inverse>(data + step.startIndex, step);
+					break;
+				case StepType::step2:
+					fftStep2<inverse>(data + step.startIndex, step);
+					break;
+				case StepType::step3:
+					fftStep3<inverse>(data + step.startIndex, step);
+					break;
+				case StepType::step4:
+					fftStep4<inverse>(data + step.startIndex, step);
+					break;
+			}
+		}
+
+		// One Stockham stage, reading all of `x` and writing all of `y`
+		template<bool inverse, typename InputIterator, typename OutputIterator>
+		void stockhamStage(InputIterator &&x, OutputIterator &&y, const StockhamStage &stage) {
+			stockhamStageScalar<inverse>(x, y, stage, 0);
+		}
+		template<bool inverse>
+		void stockhamStage(complex *x, complex *y, const StockhamStage &stage) {
+			stockhamStageContiguous<inverse>(x, y, stage, std::integral_constant<bool, Simd::enabled>{});
+		}
+		template<bool inverse>
+		void stockhamStageContiguous(complex *x, complex *y, const StockhamStage &stage, std::false_type) {
+			stockhamStageScalar<inverse>(x, y, stage, 0);
+		}
+		template<bool inverse>
+		void stockhamStageContiguous(complex *x, complex *y, const StockhamStage &stage, std::true_type) {
+			const size_t subSize = stage.subSize, radix = stage.radix;
+			if (subSize < Simd::width || radix > 4 || radix == 1) return stockhamStageScalar<inverse>(x, y, stage, 0);
+			using Vec = typename Simd::Vec;
+			const size_t stride = _size/radix;
+			const V *twiddles = plan->stockhamTwiddles.data() + stage.twiddleIndex;
+			const Vec factor3Real = Simd::set(-0.5), factor3Imag = Simd::set(inverse ? 0.8660254037844386 : -0.8660254037844386);
+
+			const size_t vectorEnd = subSize - subSize%Simd::width;
+			for (size_t base = 0; base < stride; base += subSize) {
+				for (size_t k = 0; k < vectorEnd; k += Simd::width) {
+					const complex *input = x + base + k;
+					complex *output = y + base*radix + k;
+					Vec aReal, aImag, bReal, bImag;
+					Simd::loadComplex(input, aReal, aImag);
+					Simd::loadComplex(input + stride, bReal, bImag);
+					_fft_impl::splitMul<inverse, Simd>(bReal, bImag, Simd::load(twiddles + k), Simd::load(twiddles + subSize + k), bReal, bImag);
+					if (radix == 2) {
+						Simd::storeComplex(output, Simd::add(aReal, bReal), Simd::add(aImag, bImag));
+						Simd::storeComplex(output + subSize, Simd::sub(aReal, bReal), Simd::sub(aImag, bImag));
+						continue;
+					}
+					Vec cReal, cImag;
+					Simd::loadComplex(input + 2*stride, cReal, cImag);
+					_fft_impl::splitMul<inverse, Simd>(cReal, cImag, Simd::load(twiddles + 2*subSize + k), Simd::load(twiddles + 3*subSize + k), cReal, cImag);
+					Vec outReal, outImag;
+					if (radix == 3) {
+						Vec realSumReal = Simd::add(aReal, Simd::mul(Simd::add(bReal, cReal), factor3Real));
+						Vec realSumImag = Simd::add(aImag, Simd::mul(Simd::add(bImag, cImag), factor3Real));
+						Vec imagSumReal = Simd::mul(Simd::sub(bReal, cReal), factor3Imag);
+						Vec imagSumImag = Simd::mul(Simd::sub(bImag, cImag), factor3Imag);
+
+						Simd::storeComplex(output, Simd::add(Simd::add(aReal, bReal), cReal), Simd::add(Simd::add(aImag, bImag), cImag));
+						_fft_impl::splitAddI<false, Simd>(realSumReal, realSumImag, imagSumReal, imagSumImag, outReal, outImag);
+						Simd::storeComplex(output + subSize, outReal, outImag);
+						_fft_impl::splitAddI<true, Simd>(realSumReal, realSumImag, imagSumReal, imagSumImag, outReal, outImag);
+						Simd::storeComplex(output + 2*subSize, outReal, outImag);
+						continue;
+					}
+					Vec dReal, dImag;
+					Simd::loadComplex(input + 3*stride, dReal, dImag);
+					_fft_impl::splitMul<inverse, Simd>(dReal, dImag, Simd::load(twiddles + 4*subSize + k), Simd::load(twiddles + 5*subSize + k), dReal, dImag);
+
+					// Radix-4, with the inputs in natural order (a, b, c, d)
+					Vec sumACReal = Simd::add(aReal, cReal), sumACImag = Simd::add(aImag, cImag);
+					Vec sumBDReal = Simd::add(bReal, dReal), sumBDImag = Simd::add(bImag, dImag);
+					Vec diffACReal = Simd::sub(aReal, cReal), diffACImag = Simd::sub(aImag, cImag);
+					Vec diffBDReal = Simd::sub(bReal, dReal), diffBDImag = Simd::sub(bImag, dImag);
+
+					Simd::storeComplex(output, Simd::add(sumACReal, sumBDReal), Simd::add(sumACImag, sumBDImag));
+					_fft_impl::splitAddI<!inverse, Simd>(diffACReal, diffACImag, diffBDReal, diffBDImag, outReal, outImag);
+					Simd::storeComplex(output + subSize, outReal, outImag);
+					Simd::storeComplex(output + 2*subSize, Simd::sub(sumACReal, sumBDReal), Simd::sub(sumACImag, sumBDImag));
+					_fft_impl::splitAddI<inverse, Simd>(diffACReal, diffACImag, diffBDReal, diffBDImag, outReal, outImag);
+					Simd::storeComplex(output + 3*subSize, outReal, outImag);
+				}
+			}
+			if (vectorEnd < subSize) stockhamStageScalar<inverse>(x, y, stage, vectorEnd);
+		}
+		// Does the part of each sub-transform from `kStart` onwards
+		template<bool inverse, typename InputIterator, typename OutputIterator>
+		void stockhamStageScalar(InputIterator &&x, OutputIterator &&y, const StockhamStage &stage, size_t kStart) {
+			const size_t subSize = stage.subSize, radix = stage.radix;
+			const size_t stride = _size/radix;
+			const V *twiddles = plan->stockhamTwiddles.data() + stage.twiddleIndex;
+			constexpr complex factor3 = {-0.5, inverse ? 0.8660254037844386 : -0.8660254037844386};
+			complex *working = workingVector.data();
+
+			for (size_t base = 0; base < stride; base += subSize) {
+				for (size_t k = kStart; k < subSize; ++k) {
+					size_t inputIndex = base + k, outputIndex = base*radix + k;
+					working[0] = x[inputIndex];
+					for (size_t r = 1; r < radix; ++r) {
+						complex twiddle = {twiddles[2*(r - 1)*subSize + k], twiddles[(2*r - 1)*subSize + k]};
+						working[r] = _fft_impl::complexMul<inverse>(x[inputIndex + r*stride], twiddle);
+					}
+					if (radix == 2) {
+						y[outputIndex] = working[0] + working[1];
+						y[outputIndex + subSize] = working[0] - working[1];
+					} else if (radix == 3) {
+						complex A = working[0], B = working[1], C = working[2];
+						complex realSum = A + (B + C)*factor3.real();
+						complex imagSum = (B - C)*factor3.imag();
+						y[outputIndex] = A + B + C;
+						y[outputIndex + subSize] = _fft_impl::complexAddI<false>(realSum, imagSum);
+						y[outputIndex + 2*subSize] = _fft_impl::complexAddI<true>(realSum, imagSum);
+					} else if (radix == 4) {
+						complex sumAC = working[0] + working[2], sumBD = working[1] + working[3];
+						complex diffAC = working[0] - working[2], diffBD = working[1] - working[3];
+						y[outputIndex] = sumAC + sumBD;
+						y[outputIndex + subSize] = _fft_impl::complexAddI<!inverse>(diffAC, diffBD);
+						y[outputIndex + 2*subSize] = sumAC - sumBD;
+						y[outputIndex + 3*subSize] = _fft_impl::complexAddI<inverse>(diffAC, diffBD);
+					} else {
+						for (size_t f = 0; f < radix; ++f) {
+							complex sum = working[0];
+							for (size_t r = 1; r < radix; ++r) {
+								double phase = 2*M_PI*f*r/radix;
+								complex twiddle = {V(std::cos(phase)), V(-std::sin(phase))};
+								sum += _fft_impl::complexMul<inverse>(working[r], twiddle);
+							}
+							y[outputIndex + f*subSize] = sum;
+						}
+					}
+				}
+			}
+		}
+		// Runs one Stockham stage, ping-ponging so that the last one writes to the output
+		template<bool inverse, typename InputIterator, typename OutputIterator>
+		void runStockhamStage(InputIterator &&input, OutputIterator &&data, size_t stageIndex) {
+			const auto &stages = plan->stockhamStages;
+			bool toOutput = (stages.size() - 1 - stageIndex)%2 == 0;
+			complex *buffer = stockhamVector.data();
+			if (stageIndex == 0) {
+				if (toOutput) {
+					stockhamStage<inverse>(input, data, stages[0]);
+				} else {
+					stockhamStage<inverse>(input, buffer, stages[0]);
+				}
+			} else if (toOutput) {
+				stockhamStage<inverse>(buffer, data, stages[stageIndex]);
+			} else {
+				stockhamStage<inverse>(data, buffer, stages[stageIndex]);
+			}
+		}
+
 		template<bool inverse, typename InputIterator, typename OutputIterator>
 		void run(InputIterator &&input, OutputIterator &&data) {
+			if (plan->stockham) {
+				for (size_t s = 0; s < plan->stockhamStages.size(); ++s) {
+					runStockhamStage<inverse>(input, data, s);
+				}
+				return;
+			}
 			permute(input, data);
 			
-			for (const Step &step : plan) {
-				switch (step.type) {
-					case StepType::generic:
-						fftStepGeneric<inverse>(data + step.startIndex, step);
-						break;
-					case StepType::step2:
-						fftStep2<inverse>(data + step.startIndex, step);
-						break;
-					case StepType::step3:
-						fftStep3<inverse>(data + step.startIndex, step);
-						break;
-					case StepType::step4:
-						fftStep4<inverse>(data + step.startIndex, step);
-						break;
-				}
+			for (const Step &step : plan->steps) {
+				runStep<inverse>(data, step);
+			}
+		}
+
+		// Times both kinds of plan, and returns the faster
+		static std::shared_ptr<const Plan> fasterPlan(std::shared_ptr<const Plan> permuted, std::shared_ptr<const Plan> stockham) {
+			FFT permutedFft(permuted), stockhamFft(stockham);
+			size_t size = permuted->size;
+			std::vector<complex> input(size), output(size);
+			for (size_t i = 0; i < size; ++i) {
+				input[i] = {V(std::cos(i*0.1)), V(std::sin(i*0.37))};
 			}
+			using Clock = std::chrono::steady_clock;
+			auto bestTime = [&](FFT &fft) {
+				size_t repeats = std::max<size_t>(1, 32768/size);
+				auto start = Clock::now();
+				for (size_t r = 0; r < repeats; ++r) fft.fft(input.data(), output.data());
+				return Clock::now() - start;
+			};
+			// alternate between them, and keep the best time for each, since slower runs were interrupted or still warming up
+			auto permutedTime = bestTime(permutedFft), stockhamTime = bestTime(stockhamFft);
+			for (int round = 0; round < 4; ++round) {
+				permutedTime = std::min(permutedTime, bestTime(permutedFft));
+				stockhamTime = std::min(stockhamTime, bestTime(stockhamFft));
+			}
+			return stockhamTime < permutedTime ? stockham : permuted;
+		}
+		static std::shared_ptr<const Plan> createPlan(size_t size) {
+			// Small sizes fit in cache whichever way round, so they aren't worth timing
+			if (size < 2 || SIGNALSMITH_FFT_STOCKHAM == 0 || (SIGNALSMITH_FFT_STOCKHAM < 0 && size < 64)) {
+				return std::make_shared<Plan>(size);
+			}
+			auto stockham = std::make_shared<Plan>(size, true);
+			if (SIGNALSMITH_FFT_STOCKHAM > 0) return stockham;
+			return fasterPlan(std::make_shared<Plan>(size), stockham);
+		}
+		// Uses a particular plan, without going through the shared cache
+		explicit FFT(std::shared_ptr<const Plan> withPlan) : _size(withPlan->size), plan(withPlan) {
+			allocateBuffers();
+		}
+		void allocateBuffers() {
+			workingVector.resize(_size);
+			stockhamVector.resize(plan->stockham ? _size : 0);
 		}
 
 		static bool validSize(size_t size) {
@@ -363,10 +1041,13 @@ namespace signalsmith { namespace fft {
 		}
 
 		size_t setSize(size_t size) {
-			if (size != _size) {
+			if (size != _size || !plan) {
 				_size = size;
-				workingVector.resize(size);
-				setPlan();
+				static _fft_impl::SharedCache<size_t, Plan> planCache;
+				plan = planCache.get(size, [&]() {
+					return createPlan(size);
+				});
+				allocateBuffers();
 			}
 			return _size;
 		}
@@ -393,6 +1074,50 @@ namespace signalsmith { namespace fft {
 			auto outputIter = _fft_impl::GetIterator<OutputIterator>::get(output);
 			return run<true>(inputIter, outputIter);
 		}
+
+		/** @name Batched transforms
+			Transforms several signals of this size (e.g. the channels of a multi-channel signal), for any types where `inputs[c]`/`outputs[c]` work as iterators.
+
+			Each channel is transformed whole before moving on to the next.  Interleaving the steps across channels (so each group of twiddles is loaded once for all of them) was measured slower: the twiddles stay in cache anyway, but each extra channel's data pushes the others out of L1.
+			@{ */
+		template<typename Inputs, typename Outputs>
+		void fftBatch(size_t channels, Inputs &&inputs, Outputs &&outputs) {
+			for (size_t c = 0; c < channels; ++c) {
+				fft(inputs[c], outputs[c]);
+			}
+		}
+		template<typename Inputs, typename Outputs>
+		void ifftBatch(size_t channels, Inputs &&inputs, Outputs &&outputs) {
+			for (size_t c = 0; c < channels; ++c) {
+				ifft(inputs[c], outputs[c]);
+			}
+		}
+		/// @}
+
+		/** @name Stepped transforms
+			A transform can also be run as a sequence of `.steps()` separate calls (e.g. to spread the work out over time).  All the steps must be run in order, with the same input/output, and nothing else using this FFT in between.
+			@{ */
+		size_t steps() const {
+			if (plan->stockham) return plan->stockhamStages.size();
+			return plan->steps.size() + 1;
+		}
+		template<typename InputIterator, typename OutputIterator>
+		void fftStep(InputIterator &&input, OutputIterator &&output, size_t stepIndex) {
+			auto inputIter = _fft_impl::GetIterator<InputIterator>::get(input);
+			auto outputIter = _fft_impl::GetIterator<OutputIterator>::get(output);
+			if (plan->stockham) return runStockhamStage<false>(inputIter, outputIter, stepIndex);
+			if (stepIndex == 0) return permute(inputIter, outputIter);
+			runStep<false>(outputIter, plan->steps[stepIndex - 1]);
+		}
+		template<typename InputIterator, typename OutputIterator>
+		void ifftStep(InputIterator &&input, OutputIterator &&output, size_t stepIndex) {
+			auto inputIter = _fft_impl::GetIterator<InputIterator>::get(input);
+			auto outputIter = _fft_impl::GetIterator<OutputIterator>::get(output);
+			if (plan->stockham) return runStockhamStage<true>(inputIter, outputIter, stepIndex);
+			if (stepIndex == 0) return permute(inputIter, outputIter);
+			runStep<true>(outputIter, plan->steps[stepIndex - 1]);
+		}
+		/// @}
 	};
 
 	struct FFTOptions {
@@ -405,8 +1130,28 @@ namespace signalsmith { namespace fft {
 
 		using complex = std::complex<V>;
 		std::vector<complex> complexBuffer1, complexBuffer2;
-		std::vector<complex> twiddlesMinusI;
-		std::vector<complex> modifiedRotations;
+		// Rotations for the real/complex conversion, shared between all `RealFFT`s of the same size and type
+		struct Tables {
+			std::vector<complex> twiddlesMinusI;
+			std::vector<complex> modifiedRotations;
+
+			Tables(size_t size) {
+				size_t hhSize = size/4 + 1;
+				twiddlesMinusI.resize(hhSize);
+				for (size_t i = 0; i < hhSize; ++i) {
+					V rotPhase = -2*M_PI*(modified ? i + 0.5 : i)/size;
+					twiddlesMinusI[i] = {std::sin(rotPhase), -std::cos(rotPhase)};
+				}
+				if (modified) {
+					modifiedRotations.resize(size/2);
+					for (size_t i = 0; i < size/2; ++i) {
+						V rotPhase = -2*M_PI*i/size;
+						modifiedRotations[i] = {std::cos(rotPhase), std::sin(rotPhase)};
+					}
+				}
+			}
+		};
+		std::shared_ptr<const Tables> tables;
 		FFT<V> complexFft;
 	public:
 		static size_t fastSizeAbove(size_t size) {
@@ -426,18 +1171,11 @@ namespace signalsmith { namespace fft {
 			complexBuffer1.resize(size/2);
 			complexBuffer2.resize(size/2);
 
-			size_t hhSize = size/4 + 1;
-			twiddlesMinusI.resize(hhSize);
-			for (size_t i = 0; i < hhSize; ++i) {
-				V rotPhase = -2*M_PI*(modified ? i + 0.5 : i)/size;
-				twiddlesMinusI[i] = {std::sin(rotPhase), -std::cos(rotPhase)};
-			}
-			if (modified) {
-				modifiedRotations.resize(size/2);
-				for (size_t i = 0; i < size/2; ++i) {
-					V rotPhase = -2*M_PI*i/size;
-					modifiedRotations[i] = {std::cos(rotPhase), std::sin(rotPhase)};
-				}
+			if (!tables || size != this->size()) {
+				static _fft_impl::SharedCache<size_t, Tables> tableCache;
+				tables = tableCache.get(size, [&]() {
+					return std::make_shared<Tables>(size);
+				});
 			}
 			
 			return complexFft.setSize(size/2);
@@ -455,6 +1193,7 @@ namespace signalsmith { namespace fft {
 		template<typename InputIterator, typename OutputIterator>
 		void fft(InputIterator &&input, OutputIterator &&output) {
 			size_t hSize = complexFft.size();
+			const complex *twiddlesMinusI = tables->twiddlesMinusI.data(), *modifiedRotations = tables->modifiedRotations.data();
 			for (size_t i = 0; i < hSize; ++i) {
 				if (modified) {
 					complexBuffer1[i] = _fft_impl::complexMul<false>({input[2*i], input[2*i + 1]}, modifiedRotations[i]);
@@ -483,7 +1222,44 @@ namespace signalsmith { namespace fft {
 
 		template<typename InputIterator, typename OutputIterator>
 		void ifft(InputIterator &&input, OutputIterator &&output) {
+			ifftPre(input);
+			complexFft.ifft(complexBuffer1.data(), complexBuffer2.data());
+			ifftPost(output);
+		}
+
+		/// Transforms several signals at once, for any types where `inputs[c][i]`/`outputs[c][i]` work (see `FFT::fftBatch()`)
+		template<typename Inputs, typename Outputs>
+		void fftBatch(size_t channels, Inputs &&inputs, Outputs &&outputs) {
+			for (size_t c = 0; c < channels; ++c) {
+				fft(inputs[c], outputs[c]);
+			}
+		}
+		template<typename Inputs, typename Outputs>
+		void ifftBatch(size_t channels, Inputs &&inputs, Outputs &&outputs) {
+			for (size_t c = 0; c < channels; ++c) {
+				ifft(inputs[c], outputs[c]);
+			}
+		}
+
+		/// Number of calls needed for a stepped inverse transform (see `FFT::steps()`)
+		size_t ifftSteps() const {
+			return complexFft.steps() + 2;
+		}
+		template<typename InputIterator, typename OutputIterator>
+		void ifftStep(InputIterator &&input, OutputIterator &&output, size_t stepIndex) {
+			if (stepIndex == 0) {
+				ifftPre(input);
+			} else if (stepIndex <= complexFft.steps()) {
+				complexFft.ifftStep(complexBuffer1.data(), complexBuffer2.data(), stepIndex - 1);
+			} else {
+				ifftPost(output);
+			}
+		}
+	private:
+		template<typename InputIterator>
+		void ifftPre(InputIterator &&input) {
 			size_t hSize = complexFft.size();
+			const complex *twiddlesMinusI = tables->twiddlesMinusI.data();
 			if (!modified) complexBuffer1[0] = {
 				input[0].real() + input[0].imag(),
 				input[0].real() - input[0].imag()
@@ -499,9 +1275,11 @@ namespace signalsmith { namespace fft {
 				complexBuffer1[i] = odd + evenI;
 				complexBuffer1[conjI] = conj(odd - evenI);
 			}
-			
-			complexFft.ifft(complexBuffer1.data(), complexBuffer2.data());
-			
+		}
+		template<typename OutputIterator>
+		void ifftPost(OutputIterator &&output) {
+			size_t hSize = complexFft.size();
+			const complex *modifiedRotations = tables->modifiedRotations.data();
 			for (size_t i = 0; i < hSize; ++i) {
 				complex v = complexBuffer2[i];
 				if (modified) v = _fft_impl::complexMul<true>(v, modifiedRotations[i]);
@@ -85,10 +85,17 @@ namespace rates {
 			channels = nChannels;
 			halfSampleKernel.resize(kernelLength);
 			fillKaiserSinc(halfSampleKernel, kernelLength, passFreq, 1 - passFreq);
+			// The kernel is symmetric, so each tap can be applied to a mirrored pair of inputs at once
+			foldedKernel.resize(oneWayLatency);
+			for (int o = 0; o < oneWayLatency; ++o) {
+				foldedKernel[o] = (halfSampleKernel[o] + halfSampleKernel[kernelLength - 1 - o])*Sample(0.5);
+			}
 			inputStride = kernelLength + maxBlockLength;
 			inputBuffer.resize(channels*inputStride);
 			stride = (maxBlockLength + kernelLength)*2;
 			buffer.resize(stride*channels);
+			phaseInput.resize(maxBlockLength + kernelLength);
+			phaseOutput.resize(maxBlockLength);
 		}
 
 		void reset() {
@@ -117,15 +124,12 @@ namespace rates {
 			for (int i = 0; i < lowSamples; ++i) {
 				inputChannel[kernelLength + i] = data[i];
 			}
+			// Even outputs are (delayed) inputs, and odd ones are the half-sample phase
+			convolveHalfSample(inputChannel + 1, phaseOutput.data(), lowSamples);
 			Sample *output = (*this)[c];
 			for (int i = 0; i < lowSamples; ++i) {
 				output[2*i] = inputChannel[i + oneWayLatency];
-				Sample *offsetInput = inputChannel + (i + 1);
-				Sample sum = 0;
-				for (int o = 0; o < kernelLength; ++o) {
-					sum += offsetInput[o]*halfSampleKernel[o];
-				}
-				output[2*i + 1] = sum;
+				output[2*i + 1] = phaseOutput[i];
 			}
 			// Copy the end of the buffer back to the beginning
 			for (int i = 0; i < kernelLength; ++i) {
@@ -145,14 +149,15 @@ namespace rates {
 		template<class Data>
 		void downChannel(int c, Data &&data, int lowSamples) {
 			Sample *input = buffer.data() + c*stride; // no offset for latency
+			// The odd samples are the half-sample phase, so they're gathered up to be filtered contiguously
+			int phaseLength = lowSamples + kernelLength - 1;
+			for (int j = 0; j < phaseLength; ++j) {
+				phaseInput[j] = input[2*j + 1];
+			}
+			convolveHalfSample(phaseInput.data(), phaseOutput.data(), lowSamples);
 			for (int i = 0; i < lowSamples; ++i) {
 				Sample v1 = input[2*i + kernelLength];
-				Sample sum = 0;
-				for (int o = 0; o < kernelLength; ++o) {
-					Sample v2 = input[2*(i + o) + 1];
-					sum += v2*halfSampleKernel[o];
-				}
-				Sample v2 = sum;
+				Sample v2 = phaseOutput[i];
 				Sample v = (v1 + v2)*Sample(0.5);
 				data[i] = v;
 			}
@@ -175,8 +180,55 @@ namespace rates {
 		int channels;
 		int stride, inputStride;
 		std::vector<Sample> inputBuffer;
-		std::vector<Sample> halfSampleKernel;
+		std::vector<Sample> halfSampleKernel, foldedKernel;
 		std::vector<Sample> buffer;
+		std::vector<Sample> phaseInput, phaseOutput;
+
+		/// `output[i] = sum(input[i + o]*halfSampleKernel[o])`, folded around the kernel's centre
+		void convolveHalfSample(const Sample *input, Sample *output, int length) {
+			int i = convolveHalfSampleSimd(input, output, length, std::integral_constant<bool, Simd::enabled>{});
+			for (; i < length; ++i) {
+				const Sample *offsetInput = input + i;
+				Sample sum = 0;
+				for (int o = 0; o < oneWayLatency; ++o) {
+					sum += foldedKernel[o]*(offsetInput[o] + offsetInput[kernelLength - 1 - o]);
+				}
+				output[i] = sum;
+			}
+		}
+
+		/* Vectorised across neighbouring outputs, two vectors at a time so the sums don't wait on each other.  Returns how many outputs were done, and the rest are left for the scalar loop. */
+		using Simd = signalsmith::fft::_fft_impl::SplitSimd<Sample>;
+		int convolveHalfSampleSimd(const Sample *, Sample *, int, std::false_type) {
+			return 0;
+		}
+		int convolveHalfSampleSimd(const Sample *input, Sample *output, int length, std::true_type) {
+			using Vec = typename Simd::Vec;
+			constexpr int width = Simd::width;
+			int i = 0;
+			for (; i + 2*width <= length; i += 2*width) {
+				const Sample *offsetInput = input + i;
+				Vec sumA = Simd::set(0), sumB = Simd::set(0);
+				for (int o = 0; o < oneWayLatency; ++o) {
+					const Sample *mirrored = offsetInput + (kernelLength - 1 - o);
+					Vec tap = Simd::set(foldedKernel[o]);
+					sumA = Simd::add(sumA, Simd::mul(tap, Simd::add(Simd::load(offsetInput + o), Simd::load(mirrored))));
+					sumB = Simd::add(sumB, Simd::mul(tap, Simd::add(Simd::load(offsetInput + o + width), Simd::load(mirrored + width))));
+				}
+				Simd::store(output + i, sumA);
+				Simd::store(output + i + width, sumB);
+			}
+			for (; i + width <= length; i += width) {
+				const Sample *offsetInput = input + i;
+				Vec sum = Simd::set(0);
+				for (int o = 0; o < oneWayLatency; ++o) {
+					Vec pair = Simd::add(Simd::load(offsetInput + o), Simd::load(offsetInput + (kernelLength - 1 - o)));
+					sum = Simd::add(sum, Simd::mul(Simd::set(foldedKernel[o]), pair));
+				}
+				Simd::store(output + i, sum);
+			}
+			return i;
+		}
 	};
 
 /** @} */
@@ -9,6 +9,7 @@
 #include "./delay.h"
 
 #include <cmath>
+#include <algorithm>
 
 namespace signalsmith {
 namespace spectral {
@@ -30,6 +31,8 @@ namespace spectral {
 		using MRFFT = signalsmith::fft::ModifiedRealFFT<Sample>;
 		using Complex = std::complex<Sample>;
 		MRFFT mrfft{2};
+		// FFTs set up by `.reserve()`, swapped in when their size is needed
+		std::vector<MRFFT> spareFfts;
 
 		std::vector<Sample> fftWindow;
 		std::vector<Sample> timeBuffer;
@@ -55,6 +58,14 @@ namespace spectral {
 
 		/// Sets the size, returning the window for modification (initially all 1s)
 		std::vector<Sample> & setSizeWindow(int size, int rotateSamples=0) {
+			if (size != this->size()) {
+				for (auto &spare : spareFfts) {
+					if ((int)spare.size() == size) {
+						std::swap(mrfft, spare);
+						break;
+					}
+				}
+			}
 			mrfft.setSize(size);
 			fftWindow.assign(size, 1);
 			timeBuffer.resize(size);
@@ -82,6 +93,17 @@ namespace spectral {
 			}, Sample(0.5), rotateSamples);
 		}
 
+		/// Allocates everything `.setSize()` needs for this size (and the buffers for anything smaller), so switching to it later doesn't allocate
+		void reserve(int size) {
+			fftWindow.reserve(size);
+			timeBuffer.reserve(size);
+			// keeps a spare even for the current size, so it doesn't matter what size we're at when this is called
+			for (auto &spare : spareFfts) {
+				if ((int)spare.size() == size) return;
+			}
+			spareFfts.emplace_back(size);
+		}
+
 		const std::vector<Sample> & window() const {
 			return this->fftWindow;
 		}
@@ -107,11 +129,81 @@ namespace spectral {
 		void fftRaw(Input &&input, Output &&output) {
 			mrfft.fft(input, output);
 		}
+		/// Performs FFTs (with windowing) on several channels at once, for any types where `inputs[c][i]`/`outputs[c][i]` work
+		template<class Inputs, class Outputs>
+		void fftBatch(int channels, Inputs &&inputs, Outputs &&outputs) {
+			for (int c = 0; c < channels; ++c) {
+				fft(inputs[c], outputs[c]);
+			}
+		}
 
 		/// Inverse FFT, with windowing and 1/N scaling
 		template<class Input, class Output>
 		void ifft(Input &&input, Output &&output) {
 			mrfft.ifft(input, timeBuffer);
+			ifftWindow(output);
+		}
+		/// Number of calls needed for a stepped inverse FFT
+		int ifftSteps() const {
+			return int(mrfft.ifftSteps()) + 1;
+		}
+		/// Runs one part of the inverse FFT - all the steps must be run in order, with nothing else using this object in between
+		template<class Input, class Output>
+		void ifftStep(Input &&input, Output &&output, int stepIndex) {
+			if (stepIndex < int(mrfft.ifftSteps())) {
+				mrfft.ifftStep(input, timeBuffer, stepIndex);
+			} else {
+				ifftWindow(output);
+			}
+		}
+		/** Inverse FFT, with windowing and 1/N scaling, which adds the result into a pair of contiguous spans (`.first`/`.firstLength` then `.second`/`.secondLength`) instead of writing it out.
+
+		This is for overlap-add into a ring buffer (see `delay::Buffer::View::spans()`): the windowing, scaling and sum are done in one pass. */
+		template<class Input, class Spans>
+		void ifftAdd(Input &&input, const Spans &spans) {
+			mrfft.ifft(input, timeBuffer);
+			ifftWindowAdd(spans);
+		}
+		/// `.ifftAdd()` for several channels at once, where `spansFor(c)` returns the spans for each channel
+		template<class Inputs, class SpansFn>
+		void ifftAddBatch(int channels, Inputs &&inputs, SpansFn &&spansFor) {
+			for (int c = 0; c < channels; ++c) {
+				ifftAdd(inputs[c], spansFor(c));
+			}
+		}
+		/// Like `.ifftStep()`, but the last step adds into a pair of spans, as in `.ifftAdd()`
+		template<class Input, class Spans>
+		void ifftStepAdd(Input &&input, const Spans &spans, int stepIndex) {
+			if (stepIndex < int(mrfft.ifftSteps())) {
+				mrfft.ifftStep(input, timeBuffer, stepIndex);
+			} else {
+				ifftWindowAdd(spans);
+			}
+		}
+	private:
+		template<class Spans>
+		void ifftWindowAdd(const Spans &spans) {
+			Sample norm = 1/(Sample)mrfft.size();
+			addWindowed(spans.first, 0, spans.firstLength, norm);
+			addWindowed(spans.second, spans.firstLength, spans.firstLength + spans.secondLength, norm);
+		}
+		// Adds windowed samples `[start, end)` of the (un-rotated) IFFT result to `output[0, end - start)`
+		void addWindowed(Sample *output, int start, int end, Sample norm) {
+			int fftSize = (int) mrfft.size();
+			const Sample *window = fftWindow.data(), *time = timeBuffer.data();
+			Sample *shiftedOutput = output - start;
+			int split = std::min(std::max(start, offsetSamples), end);
+			for (int i = start; i < split; ++i) {
+				// Inverted polarity since we're using the MRFFT
+				shiftedOutput[i] -= time[i + fftSize - offsetSamples]*norm*window[i];
+			}
+			for (int i = split; i < end; ++i) {
+				shiftedOutput[i] += time[i - offsetSamples]*norm*window[i];
+			}
+		}
+
+		template<class Output>
+		void ifftWindow(Output &&output) {
 			int fftSize = (int) mrfft.size();
 			Sample norm = 1/(Sample)fftSize;
 
@@ -123,6 +215,7 @@ namespace spectral {
 				output[i] = timeBuffer[i - offsetSamples]*norm*fftWindow[i];
 			}
 		}
+	public:
 		/// Performs an IFFT (no windowing or rotation)
 		template<class Input, class Output>
 		void ifftRaw(Input &&input, Output &&output) {
@@ -175,6 +268,13 @@ namespace spectral {
 		int channels = 0, _windowSize = 0, _fftSize = 0, _interval = 1;
 		int validUntilIndex = 0;
 
+		// Amortised synthesis: the block started at `pendingIndex` is written at `pendingIndex + _interval`, a step at a time
+		bool amortised = false, nextAmortised = false;
+		bool pending = false, pendingSpectrum = false;
+		int pendingIndex = 0, pendingSteps = 0, stepsPerChannel = 1;
+		// how far into the interval the spectrum is requested, and the block it's for
+		int spectrumDelay = 0, pendingDelay = 0;
+
 		class MultiSpectrum {
 			int channels, stride;
 			std::vector<Complex> buffer;
@@ -188,6 +288,10 @@ namespace spectral {
 				buffer.assign(channels*stride, 0);
 			}
 			
+			void reserve(int nChannels, int nBands) {
+				buffer.reserve(nChannels*nBands);
+			}
+			
 			void reset() {
 				buffer.assign(buffer.size(), 0);
 			}
@@ -204,12 +308,13 @@ namespace spectral {
 				return buffer.data() + channel*stride;
 			}
 		};
-		std::vector<Sample> timeBuffer;
 
 		void resizeInternal(int newChannels, int windowSize, int newInterval, int historyLength, int zeroPadding) {
+			amortised = nextAmortised;
 			Super::resize(newChannels,
 				windowSize /* for output summing */
 				+ newInterval /* so we can read `windowSize` ahead (we'll be at most `interval-1` from the most recent block */
+				+ (amortised ? newInterval : 0) /* blocks are written one interval later */
 				+ historyLength);
 
 			int fftSize = fft.fastSizeAbove(windowSize + zeroPadding);
@@ -219,11 +324,12 @@ namespace spectral {
 			this->_fftSize = fftSize;
 			this->_interval = newInterval;
 			validUntilIndex = -1;
+			pending = pendingSpectrum = false;
 			
 			setWindow(windowShape);
+			stepsPerChannel = fft.ifftSteps(); // the last step windows and overlap-adds
 
 			spectrum.resize(channels, fftSize/2);
-			timeBuffer.resize(fftSize);
 		}
 	public:
 		enum class Window {kaiser, acg};
@@ -277,6 +383,15 @@ namespace spectral {
 			resizeInternal(nChannels, windowSize, interval, historyLength, zeroPadding);
 		}
 		
+		/** Allocates enough for a later `.resize()` with these parameters (or smaller ones) not to allocate, so it can be done from the audio thread.
+			The FFT is only set up for this window length and padding, so call it for each size you want to switch between. */
+		void reserve(int nChannels, int windowSize, int interval, int historyLength=0, int zeroPadding=0) {
+			Super::reserve(nChannels, windowSize + 2*interval + historyLength); // with room for amortised synthesis
+			int fftSize = fft.fastSizeAbove(windowSize + zeroPadding);
+			fft.reserve(fftSize);
+			spectrum.reserve(nChannels, fftSize/2);
+		}
+		
 		int windowSize() const {
 			return _windowSize;
 		}
@@ -304,11 +419,25 @@ namespace spectral {
 			return result;
 		}
 		
+		/** Spreads the synthesis (inverse FFTs and overlap-add) out across each interval, instead of doing it all when a block starts.  This adds one interval of latency (see `.latency()`), and takes effect on the next `.resize()`.
+		
+			The spectrum for a block must then be left alone until the next block's spectrum is requested. */
+		void setAmortised(bool spreadOverInterval) {
+			nextAmortised = spreadOverInterval;
+		}
+		/** When amortised, requests each block's spectrum this many samples into its interval (instead of when the block starts), and spreads the synthesis over the rest.  This leaves the start of the interval free for whatever work the spectrum depends on.
+
+			It takes effect from the next block, and is limited to `interval - 1`. */
+		void setSpectrumDelay(int samples) {
+			spectrumDelay = samples;
+		}
+
 		/// Resets everything - since we clear the output sum, it will take `windowSize` samples to get proper output.
 		void reset() {
 			Super::reset();
 			spectrum.reset();
 			validUntilIndex = -1;
+			pending = pendingSpectrum = false;
 		}
 		
 		/** Generates valid output up to the specified index (or 0), using the callback as many times as needed.
@@ -316,28 +445,48 @@ namespace spectral {
 			The callback should be a functor accepting a single integer argument, which is the index for which a spectrum is required.
 			
 			The block created from these spectra will start at this index in the output, plus `.latency()`.
+
+			When amortised, the callback may be called later than the block start (see `.setSpectrumDelay()`), so it should be the same every time.
 		*/
 		template<class AnalysisFn>
 		void ensureValid(int i, AnalysisFn fn) {
+			if (amortised) {
+				while (validUntilIndex < i) {
+					int blockIndex = validUntilIndex + 1;
+					// The previous block is due now
+					flushPending(fn);
+					pending = pendingSpectrum = true;
+					pendingIndex = blockIndex;
+					pendingSteps = 0;
+					pendingDelay = std::max(0, std::min(spectrumDelay, _interval - 1));
+					validUntilIndex += _interval;
+				}
+				int elapsed = i - pendingIndex + 1 - pendingDelay;
+				if (pending && elapsed > 0) {
+					if (pendingSpectrum) {
+						fn(pendingIndex);
+						pendingSpectrum = false;
+					}
+					// Keep up with our position in the rest of the interval
+					int totalSteps = channels*stepsPerChannel, stepSamples = _interval - pendingDelay;
+					int dueSteps = (totalSteps*elapsed + stepSamples - 1)/stepSamples;
+					synthesiseSteps(std::min(dueSteps, totalSteps));
+				}
+				return;
+			}
 			while (validUntilIndex < i) {
 				int blockIndex = validUntilIndex + 1;
 				fn(blockIndex);
 
 				auto output = this->view(blockIndex);
 				for (int c = 0; c < channels; ++c) {
-					auto channel = output[c];
-
 					// Clear out the future sum, a window-length and an interval ahead
-					for (int wi = _windowSize; wi < _windowSize + _interval; ++wi) {
-						channel[wi] = 0;
-					}
-
-					// Add in the IFFT'd result
-					fft.ifft(spectrum[c], timeBuffer);
-					for (int wi = 0; wi < _windowSize; ++wi) {
-						channel[wi] += timeBuffer[wi];
-					}
+					(output[c] + _windowSize).fill(_interval, 0);
 				}
+				// Add in the IFFT'd result (all channels together)
+				fft.ifftAddBatch(channels, spectrum, [&](int c) {
+					return output[c].spans(0, _windowSize);
+				});
 				validUntilIndex += _interval;
 			}
 		}
@@ -346,6 +495,15 @@ namespace spectral {
 		void ensureValid(AnalysisFn fn) {
 			return ensureValid(0, fn);
 		}
+		/// Completes any amortised synthesis which is still in progress (requesting its spectrum if that's still due), so the whole future sum can be read
+		template<class AnalysisFn>
+		void flushPending(AnalysisFn fn) {
+			if (pending && pendingSpectrum) {
+				fn(pendingIndex);
+				pendingSpectrum = false;
+			}
+			synthesiseSteps(channels*stepsPerChannel);
+		}
 		/// Returns the next invalid index (a.k.a. the index of the next block)
 		int nextInvalid() const {
 			return validUntilIndex + 1;
@@ -356,9 +514,7 @@ namespace spectral {
 		Results can be read/edited using `.spectrum`. */
 		template<class Data>
 		void analyse(Data &&data) {
-			for (int c = 0; c < channels; ++c) {
-				fft.fft(data[c], spectrum[c]);
-			}
+			fft.fftBatch(channels, data, spectrum);
 		}
 		template<class Data>
 		void analyse(int c, Data &&data) {
@@ -382,9 +538,9 @@ namespace spectral {
 
 		/** Internal latency (between the block-index requested in `.ensureValid()` and its position in the output)
  
-		Currently unused, but it's in here to allow for a future implementation which spreads the FFT calculations out across each interval.*/
-		int latency() {
-			return 0;
+		This is one interval when the synthesis is amortised (see `.setAmortised()`), and 0 otherwise.*/
+		int latency() const {
+			return amortised ? _interval : 0;
 		}
 		
 		// @name Shift the underlying buffer (moving the "valid" index accordingly)
@@ -392,21 +548,25 @@ namespace spectral {
 		STFT & operator ++() {
 			Super::operator ++();
 			validUntilIndex--;
+			pendingIndex--;
 			return *this;
 		}
 		STFT & operator +=(int i) {
 			Super::operator +=(i);
 			validUntilIndex -= i;
+			pendingIndex -= i;
 			return *this;
 		}
 		STFT & operator --() {
 			Super::operator --();
 			validUntilIndex++;
+			pendingIndex++;
 			return *this;
 		}
 		STFT & operator -=(int i) {
 			Super::operator -=(i);
 			validUntilIndex += i;
+			pendingIndex += i;
 			return *this;
 		}
 		// @}
@@ -414,13 +574,33 @@ namespace spectral {
 		typename Super::MutableView operator ++(int postIncrement) {
 			auto result = Super::operator ++(postIncrement);
 			validUntilIndex--;
+			pendingIndex--;
 			return result;
 		}
 		typename Super::MutableView operator --(int postIncrement) {
 			auto result = Super::operator --(postIncrement);
 			validUntilIndex++;
+			pendingIndex++;
 			return result;
 		}
+
+	private:
+		// Runs the pending block's synthesis up to a particular step
+		void synthesiseSteps(int untilStep) {
+			if (!pending) return;
+			while (pendingSteps < untilStep) {
+				int c = pendingSteps/stepsPerChannel, step = pendingSteps%stepsPerChannel;
+				auto channel = this->view(pendingIndex + _interval)[c];
+				if (step == stepsPerChannel - 1) {
+					// Clear out the future sum, a window-length and an interval ahead
+					(channel + _windowSize).fill(_interval, 0);
+				}
+				// The last step adds in the IFFT'd result
+				fft.ifftStepAdd(spectrum[c], channel.spans(0, _windowSize), step);
+				++pendingSteps;
+			}
+			if (pendingSteps >= channels*stepsPerChannel) pending = false;
+		}
 	};
 
 	/** STFT processing, with input/output.
@@ -6,6 +6,8 @@
 #include "dsp/perf.h"
 SIGNALSMITH_DSP_VERSION_CHECK(1, 6, 0); // Check version is compatible
 #include <vector>
+#include <array>
+#include <cstdint>
 #include <algorithm>
 #include <functional>
 #include <random>
@@ -15,99 +17,269 @@ namespace signalsmith { namespace stretch {
 template<typename Sample=float>
 struct SignalsmithStretch {
 
-	SignalsmithStretch() : randomEngine(std::random_device{}()) {}
-	SignalsmithStretch(long seed) : randomEngine(seed) {}
+	SignalsmithStretch() : SignalsmithStretch(long(std::random_device{}())) {}
+	SignalsmithStretch(long seed) : seed(seed), voices(1) {
+		voices[0].random.seed(seed);
+	}
 
 	int blockSamples() const {
-		return stft.windowSize();
+		return voices[0].stft.windowSize();
 	}
 	int intervalSamples() const {
-		return stft.interval();
+		return voices[0].stft.interval();
 	}
 	int inputLatency() const {
-		return stft.windowSize()/2;
+		return blockSamples()/2;
 	}
 	int outputLatency() const {
-		return stft.windowSize() - inputLatency();
+		return blockSamples() - inputLatency() + voices[0].stft.latency();
+	}
+	/// Number of pitch voices sharing the same analysis
+	int voiceCount() const {
+		return int(voices.size());
 	}
 	
 	void reset() {
-		stft.reset();
+		for (auto &voice : voices) {
+			// anything still scheduled happens straight away
+			if (voice.scheduledCount > 0) {
+				const auto &latest = voice.scheduled[voice.scheduledCount - 1];
+				applyTranspose(voice, latest.multiplier, latest.tonalityLimit);
+				voice.scheduledCount = 0;
+			}
+			voice.stft.reset();
+			voice.output.clear();
+			voice.prevOutput.clear();
+		}
+		validUntilIndex = -1;
 		inputBuffer.reset();
+		inputTime = 0;
 		prevInputOffset = -1;
-		channelBands.assign(channelBands.size(), Band());
-		silenceCounter = 2*stft.windowSize();
+		bandInput.clear();
+		bandPrevInput.clear();
+		bandInputEnergy.clear();
+		silenceCounter = 2*blockSamples();
 		didSeek = false;
 		flushed = true;
+		analysisStep = analysisSteps = 0;
+		blockPending = false;
 	}
 
 	// Configures using a default preset
-	void presetDefault(int nChannels, Sample sampleRate) {
-		configure(nChannels, sampleRate*0.12, sampleRate*0.03);
+	void presetDefault(int nChannels, Sample sampleRate, int nVoices=1) {
+		configure(nChannels, sampleRate*0.12, sampleRate*0.03, nVoices);
 	}
-	void presetCheaper(int nChannels, Sample sampleRate) {
-		configure(nChannels, sampleRate*0.1, sampleRate*0.04);
+	void presetCheaper(int nChannels, Sample sampleRate, int nVoices=1) {
+		configure(nChannels, sampleRate*0.1, sampleRate*0.04, nVoices);
 	}
 
-	// Manual setup
-	void configure(int nChannels, int blockSamples, int intervalSamples) {
+	/** Manual setup
+
+		Each voice has its own frequency map and output, but the input analysis (FFT, energy smoothing and peak-detection) is shared between them. */
+	void configure(int nChannels, int blockSamples, int intervalSamples, int nVoices=1) {
 		channels = nChannels;
-		stft.resize(channels, blockSamples, intervalSamples);
-		bands = stft.bands();
+		int oldVoices = int(voices.size());
+		voices.resize(std::max(nVoices, 1));
+		for (int v = oldVoices; v < int(voices.size()); ++v) {
+			voices[v].random.seed(seed + v);
+		}
+		for (auto &voice : voices) {
+			voice.stft.setAmortised(amortised);
+			voice.stft.resize(channels, blockSamples, intervalSamples);
+		}
+		validUntilIndex = -1;
+		bands = voices[0].stft.bands();
 		inputBuffer.resize(channels, blockSamples + intervalSamples + 1);
-		timeBuffer.assign(stft.fftSize(), 0);
-		channelBands.assign(bands*channels, Band());
+		timeBufferStride = voices[0].stft.fftSize();
+		timeBuffer.assign(2*channels*timeBufferStride, 0);
+		analysisStep = analysisSteps = 0;
+		blockPending = false;
+		bandInput.resize(channels, bands);
+		bandPrevInput.resize(channels, bands);
+		bandInputEnergy.resize(channels, bands);
 		
 		// Various phase rotations
-		rotCentreSpectrum.resize(bands);
-		rotPrevInterval.assign(bands, 0);
+		rotCentreSpectrum.resize(1, bands);
+		rotPrevInterval.resize(1, bands);
 		timeShiftPhases(blockSamples*Sample(-0.5), rotCentreSpectrum);
 		timeShiftPhases(-intervalSamples, rotPrevInterval);
-		peaks.reserve(bands);
+		peakBands.reserve(bands);
 		energy.resize(bands);
 		smoothedEnergy.resize(bands);
-		outputMap.resize(bands);
-		channelPredictions.resize(channels*bands);
+		activeVoices.resize(voices.size());
+		for (auto &voice : voices) {
+			voice.output.resize(channels, bands);
+			voice.prevOutput.resize(channels, bands);
+			voice.peaks.reserve(bands);
+			voice.outputMap.resize(bands);
+			updateBandMap(voice);
+			voice.previousBandMap.reserve(bands + 1);
+			voice.previousValid = false; // sampled for a different band count
+			voice.predictionEnergy.resize(channels, bands);
+			voice.predictionInput.resize(channels, bands);
+			voice.shortVerticalTwist.resize(channels, bands);
+			voice.longVerticalTwist.resize(channels, bands);
+			voice.predictionPositions.resize(bands);
+			voice.shortVerticalPositions.resize(bands);
+			voice.longVerticalPositions.resize(bands);
+			voice.binTimeFactors.resize(bands);
+			voice.maxChannels.resize(bands);
+		}
+	}
+
+	/** Allocates everything up-front for configurations up to this size, so that `.configure()` (with no more than these sizes, and the same number of voices) doesn't allocate, and can be called from the audio thread.
+		The FFT is only set up for this block length, so to switch between several block lengths, call this for each of them.  Call this after `.configure()`, since it only reserves for the voices which exist. */
+	void reserve(int maxChannels, int maxBlockSamples, int maxIntervalSamples) {
+		for (auto &voice : voices) {
+			voice.stft.reserve(maxChannels, maxBlockSamples, maxIntervalSamples);
+		}
+		int fftSize = signalsmith::spectral::WindowedFFT<Sample>::fastSizeAbove(maxBlockSamples);
+		int maxBands = fftSize/2;
+		inputBuffer.reserve(maxChannels, maxBlockSamples + maxIntervalSamples + 1);
+		timeBuffer.reserve(2*maxChannels*fftSize);
+		bandInput.reserve(maxChannels, maxBands);
+		bandPrevInput.reserve(maxChannels, maxBands);
+		bandInputEnergy.reserve(maxChannels, maxBands);
+		rotCentreSpectrum.reserve(1, maxBands);
+		rotPrevInterval.reserve(1, maxBands);
+		peakBands.reserve(maxBands);
+		energy.reserve(maxBands);
+		smoothedEnergy.reserve(maxBands);
+		for (auto &voice : voices) {
+			voice.output.reserve(maxChannels, maxBands);
+			voice.prevOutput.reserve(maxChannels, maxBands);
+			voice.peaks.reserve(maxBands);
+			voice.outputMap.reserve(maxBands);
+			voice.bandMap.reserve(maxBands + 1);
+			voice.previousBandMap.reserve(maxBands + 1);
+			voice.predictionEnergy.reserve(maxChannels, maxBands);
+			voice.predictionInput.reserve(maxChannels, maxBands);
+			voice.shortVerticalTwist.reserve(maxChannels, maxBands);
+			voice.longVerticalTwist.reserve(maxChannels, maxBands);
+			voice.predictionPositions.reserve(maxBands);
+			voice.shortVerticalPositions.reserve(maxBands);
+			voice.longVerticalPositions.reserve(maxBands);
+			voice.binTimeFactors.reserve(maxBands);
+			voice.maxChannels.reserve(maxBands);
+		}
+	}
+
+	/** Spreads the work for each block out across the following interval, so the CPU load is smoother for small blocks.
+		The shared analysis and spectral processing go first, then each voice's spectral processing and synthesis.  This adds one interval to the `.outputLatency()`, and (if it changes anything) re-configures with the current settings. */
+	void setAmortised(bool spreadOverInterval) {
+		if (spreadOverInterval == amortised) return;
+		amortised = spreadOverInterval;
+		if (channels > 0) configure(channels, blockSamples(), intervalSamples(), voiceCount());
+	}
+
+	/// A batch of independent jobs (one for each active voice), which can run in any order and on any thread
+	class VoiceJobs {
+		friend struct SignalsmithStretch;
+		int count;
+		void *context;
+		void (*runJob)(void *context, int job);
+
+		VoiceJobs(int count, void *context, void (*runJob)(void *, int)) : count(count), context(context), runJob(runJob) {}
+	public:
+		int size() const {
+			return count;
+		}
+		void run(int job) const {
+			runJob(context, job);
+		}
+	};
+	using VoiceRunner = std::function<void(const VoiceJobs &)>;
+
+	/** After the shared analysis, each voice's spectral processing and synthesis is independent.  This hands those jobs to `runner`, which could share them between threads.
+		The runner has to run every job exactly once, and only return when they've all finished.  With no runner (the default) they run in turn. */
+	void setVoiceRunner(VoiceRunner runner) {
+		voiceRunner = runner;
 	}
 
 	/// Frequency multiplier, and optional tonality limit (as multiple of sample-rate)
 	void setTransposeFactor(Sample multiplier, Sample tonalityLimit=0) {
-		freqMultiplier = multiplier;
-		if (tonalityLimit > 0) {
-			freqTonalityLimit = tonalityLimit/std::sqrt(multiplier); // compromise between input and output limits
-		} else {
-			freqTonalityLimit = 1;
-		}
-		customFreqMap = nullptr;
+		setVoiceTransposeFactor(0, multiplier, tonalityLimit);
 	}
 	void setTransposeSemitones(Sample semitones, Sample tonalityLimit=0) {
-		setTransposeFactor(std::pow(2, semitones/12), tonalityLimit);
-		customFreqMap = nullptr;
+		setVoiceTransposeSemitones(0, semitones, tonalityLimit);
 	}
-	// Sets a custom frequency map - should be monotonically increasing
+	/// Sets a custom frequency map - should be monotonically increasing
+	/// This is sampled once per band when it's set (and when re-configured), and peaks are mapped by interpolating between those
 	void setFreqMap(std::function<Sample(Sample)> inputToOutput) {
-		customFreqMap = inputToOutput;
+		setVoiceFreqMap(0, inputToOutput);
+	}
+
+	/// The same as above, for a particular voice
+	/// These take effect straight away, and cancel anything scheduled for the voice
+	void setVoiceTransposeFactor(int v, Sample multiplier, Sample tonalityLimit=0) {
+		Voice &voice = voices[v];
+		voice.scheduledCount = 0;
+		applyTranspose(voice, multiplier, tonalityLimit);
+	}
+	void setVoiceTransposeSemitones(int v, Sample semitones, Sample tonalityLimit=0) {
+		setVoiceTransposeFactor(v, std::pow(2, semitones/12), tonalityLimit);
+	}
+	void setVoiceFreqMap(int v, std::function<Sample(Sample)> inputToOutput) {
+		Voice &voice = voices[v];
+		voice.scheduledCount = 0;
+		voice.customFreqMap = inputToOutput;
+		voice.previousValid = false;
+		updateBandMap(voice);
+	}
+
+	/** Schedules a transpose, from input sample `inputOffset` of the next `.process()`/`.processVoices()` call.
+		It takes effect from the first block whose processing time (see "Automation" in the README) reaches that sample, so changes line up with the input whatever the block size.  Changes should be scheduled in order.
+		Re-scheduling the current transpose costs nothing, and switching back to the one before re-uses its frequency map. */
+	void scheduleVoiceTransposeFactor(int v, int inputOffset, Sample multiplier, Sample tonalityLimit=0) {
+		Voice &voice = voices[v];
+		if (voice.scheduledCount == Voice::maxScheduled) { // no room, so the oldest change happens now
+			applyTranspose(voice, voice.scheduled[0].multiplier, voice.scheduled[0].tonalityLimit);
+			std::move(voice.scheduled.begin() + 1, voice.scheduled.end(), voice.scheduled.begin());
+			--voice.scheduledCount;
+		}
+		voice.scheduled[voice.scheduledCount++] = {inputTime + inputOffset, multiplier, tonalityLimit};
+	}
+	void scheduleVoiceTransposeSemitones(int v, int inputOffset, Sample semitones, Sample tonalityLimit=0) {
+		scheduleVoiceTransposeFactor(v, inputOffset, std::pow(2, semitones/12), tonalityLimit);
+	}
+
+	/** Inactive voices are skipped entirely (no spectral processing or synthesis), and their outputs are left untouched.
+		When re-activated, a voice starts from silence, fading in over one block-length. */
+	void setVoiceActive(int v, bool active) {
+		Voice &voice = voices[v];
+		if (active && !voice.active) {
+			voice.stft.reset();
+			voice.stft -= validUntilIndex + 1; // line up with the other voices
+			voice.output.clear();
+			voice.prevOutput.clear();
+			voice.clearPredictions();
+			voice.spectrumStep = voiceSpectrumSteps(); // nothing until the next block
+		}
+		voice.active = active;
+	}
+	bool voiceActive(int v) const {
+		return voices[v].active;
 	}
 
 	// Provide previous input ("pre-roll"), without affecting the speed calculation.  You should ideally feed it one block-length + one interval
 	template<class Inputs>
 	void seek(Inputs &&inputs, int inputSamples, double playbackRate) {
 		inputBuffer.reset();
-		for (int c = 0; c < channels; ++c) {
-			auto &&inputChannel = inputs[c];
-			auto &&bufferChannel = inputBuffer[c];
-			int startIndex = std::max<int>(0, inputSamples - stft.windowSize() - stft.interval());
-			for (int i = startIndex; i < inputSamples; ++i) {
-				bufferChannel[i] = inputChannel[i];
-			}
-		}
-		inputBuffer += inputSamples;
+		storeInputHistory(inputs, inputSamples, std::max<int>(0, inputSamples - blockSamples() - intervalSamples()));
 		didSeek = true;
-		seekTimeFactor = (playbackRate*stft.interval() > 1) ? 1/playbackRate : stft.interval();
+		seekTimeFactor = (playbackRate*intervalSamples() > 1) ? 1/playbackRate : intervalSamples();
 	}
 
+	/// Processes a single voice (the first one, if there are several)
 	template<class Inputs, class Outputs>
 	void process(Inputs &&inputs, int inputSamples, Outputs &&outputs, int outputSamples) {
+		processVoices(inputs, inputSamples, SingleVoice<Outputs>{outputs}, outputSamples);
+	}
+
+	/// Processes all voices, where `voiceOutputs[voice][channel][index]` is an output sample
+	template<class Inputs, class VoiceOutputs>
+	void processVoices(Inputs &&inputs, int inputSamples, VoiceOutputs &&voiceOutputs, int outputSamples) {
+		int nVoices = voiceCount();
 		Sample totalEnergy = 0;
 		for (int c = 0; c < channels; ++c) {
 			auto &&inputChannel = inputs[c];
@@ -117,42 +289,41 @@ struct SignalsmithStretch {
 			}
 		}
 		if (totalEnergy < noiseFloor) {
-			if (silenceCounter >= 2*stft.windowSize()) {
+			if (silenceCounter >= 2*blockSamples()) {
 				if (silenceFirst) {
 					silenceFirst = false;
-					for (auto &b : channelBands) {
-						b.input = b.prevInput = b.output = b.prevOutput = 0;
-						b.inputEnergy = 0;
+					bandInput.clear();
+					bandPrevInput.clear();
+					bandInputEnergy.clear();
+					for (auto &voice : voices) {
+						voice.output.clear();
+						voice.prevOutput.clear();
 					}
 				}
 			
-				if (inputSamples > 0) {
-					// copy from the input, wrapping around if needed
-					for (int outputIndex = 0; outputIndex < outputSamples; ++outputIndex) {
-						int inputIndex = outputIndex%inputSamples;
-						for (int c = 0; c < channels; ++c) {
-							outputs[c][outputIndex] = inputs[c][inputIndex];
-						}
-					}
-				} else {
-					for (int c = 0; c < channels; ++c) {
-						auto &&outputChannel = outputs[c];
+				for (int v = 0; v < nVoices; ++v) {
+					if (!voices[v].active) continue;
+					auto &&outputs = voiceOutputs[v];
+					if (inputSamples > 0) {
+						// copy from the input, wrapping around if needed
 						for (int outputIndex = 0; outputIndex < outputSamples; ++outputIndex) {
-							outputChannel[outputIndex] = 0;
+							int inputIndex = outputIndex%inputSamples;
+							for (int c = 0; c < channels; ++c) {
+								outputs[c][outputIndex] = inputs[c][inputIndex];
+							}
+						}
+					} else {
+						for (int c = 0; c < channels; ++c) {
+							auto &&outputChannel = outputs[c];
+							for (int outputIndex = 0; outputIndex < outputSamples; ++outputIndex) {
+								outputChannel[outputIndex] = 0;
+							}
 						}
 					}
 				}
 
-				// Store input in history buffer
-				for (int c = 0; c < channels; ++c) {
-					auto &&inputChannel = inputs[c];
-					auto &&bufferChannel = inputBuffer[c];
-					int startIndex = std::max<int>(0, inputSamples - stft.windowSize() - stft.interval());
-					for (int i = startIndex; i < inputSamples; ++i) {
-						bufferChannel[i] = inputChannel[i];
-					}
-				}
-				inputBuffer += inputSamples;
+				storeInputHistory(inputs, inputSamples, std::max<int>(0, inputSamples - blockSamples() - intervalSamples()));
+				inputTime += inputSamples;
 				return;
 			} else {
 				silenceCounter += inputSamples;
@@ -162,125 +333,85 @@ struct SignalsmithStretch {
 			silenceFirst = true;
 		}
 
-		for (int outputIndex = 0; outputIndex < outputSamples; ++outputIndex) {
-			stft.ensureValid(outputIndex, [&](int outputOffset) {
-				// Time to process a spectrum!  Where should it come from in the input?
-				int inputOffset = std::round(outputOffset*Sample(inputSamples)/outputSamples) - stft.windowSize();
-				int inputInterval = inputOffset - prevInputOffset;
-				prevInputOffset = inputOffset;
-
-				bool newSpectrum = didSeek || (inputInterval > 0);
-				if (newSpectrum) {
-					for (int c = 0; c < channels; ++c) {
-						// Copy from the history buffer, if needed
-						auto &&bufferChannel = inputBuffer[c];
-						for (int i = 0; i < -inputOffset; ++i) {
-							timeBuffer[i] = bufferChannel[i + inputOffset];
-						}
-						// Copy the rest from the input
-						auto &&inputChannel = inputs[c];
-						for (int i = std::max<int>(0, -inputOffset); i < stft.windowSize(); ++i) {
-							timeBuffer[i] = inputChannel[i + inputOffset];
-						}
-						stft.analyse(c, timeBuffer);
-					}
-					flushed = false; // TODO: first block after a flush should be gain-compensated
-
-					for (int c = 0; c < channels; ++c) {
-						auto channelBands = bandsForChannel(c);
-						auto &&spectrumBands = stft.spectrum[c];
-						for (int b = 0; b < bands; ++b) {
-							channelBands[b].input = signalsmith::perf::mul(spectrumBands[b], rotCentreSpectrum[b]);
-						}
-					}
+		int nActive = 0;
+		for (int v = 0; v < nVoices; ++v) {
+			if (voices[v].active) activeVoices[nActive++] = v;
+		}
 
-					if (didSeek || inputInterval != stft.interval()) { // make sure the previous input is the correct distance in the past
-						int prevIntervalOffset = inputOffset - stft.interval();
-						for (int c = 0; c < channels; ++c) {
-							// Copy from the history buffer, if needed
-							auto &&bufferChannel = inputBuffer[c];
-							for (int i = 0; i < std::min(-prevIntervalOffset, stft.windowSize()); ++i) {
-								timeBuffer[i] = bufferChannel[i + prevIntervalOffset];
-							}
-							// Copy the rest from the input
-							auto &&inputChannel = inputs[c];
-							for (int i = std::max<int>(0, -prevIntervalOffset); i < stft.windowSize(); ++i) {
-								timeBuffer[i] = inputChannel[i + prevIntervalOffset];
-							}
-							stft.analyse(c, timeBuffer);
-						}
-						for (int c = 0; c < channels; ++c) {
-							auto channelBands = bandsForChannel(c);
-							auto &&spectrumBands = stft.spectrum[c];
-							for (int b = 0; b < bands; ++b) {
-								channelBands[b].prevInput = signalsmith::perf::mul(spectrumBands[b], rotCentreSpectrum[b]);
-							}
-						}
-					}
+		// The output is split wherever a new block starts: the shared analysis is done between segments (or a part of it before each segment, when amortised), and then each voice can do its part independently
+		for (int segmentStart = 0; segmentStart < outputSamples;) {
+			int segmentEnd = outputSamples;
+			bool newBlock = false;
+			if (nActive > 0) {
+				if (validUntilIndex < segmentStart) {
+					int outputOffset = validUntilIndex + 1;
+					processBlock(inputs, inputSamples, outputSamples, outputOffset, nActive);
+					validUntilIndex = outputOffset + intervalSamples() - 1;
+					newBlock = true;
 				}
-				
-				Sample timeFactor = didSeek ? seekTimeFactor : stft.interval()/std::max<Sample>(1, inputInterval);
-				processSpectrum(newSpectrum, timeFactor);
-				didSeek = false;
-
-				for (int c = 0; c < channels; ++c) {
-					auto channelBands = bandsForChannel(c);
-					auto &&spectrumBands = stft.spectrum[c];
-					for (int b = 0; b < bands; ++b) {
-						spectrumBands[b] = signalsmith::perf::mul<true>(channelBands[b].output, rotCentreSpectrum[b]);
-					}
+				segmentEnd = std::min(outputSamples, validUntilIndex + 1);
+				if (amortised) {
+					// Keep up with our position in the start of the interval, so it's all done before any voice needs it
+					int elapsed = segmentEnd - (validUntilIndex + 1 - intervalSamples());
+					analyseSteps(std::min(analysisSteps, (analysisSteps*elapsed + analysisSamples - 1)/analysisSamples));
 				}
-			});
-
-			for (int c = 0; c < channels; ++c) {
-				auto &&outputChannel = outputs[c];
-				auto &&stftChannel = stft[c];
-				outputChannel[outputIndex] = stftChannel[outputIndex];
 			}
-		}
 
-		// Store input in history buffer
-		for (int c = 0; c < channels; ++c) {
-			auto &&inputChannel = inputs[c];
-			auto &&bufferChannel = inputBuffer[c];
-			int startIndex = std::max<int>(0, inputSamples - stft.windowSize());
-			for (int i = startIndex; i < inputSamples; ++i) {
-				bufferChannel[i] = inputChannel[i];
+			// Only worth handing out if there's spectral processing or synthesis to do, rather than just copying output
+			using Outputs = typename std::remove_reference<VoiceOutputs>::type;
+			VoiceSegment<Outputs> segment{this, &voiceOutputs, segmentStart, segmentEnd};
+			if (voiceRunner && nActive > 1 && (newBlock || amortised)) {
+				voiceRunner(VoiceJobs(nActive, &segment, &VoiceSegment<Outputs>::runJob));
+			} else {
+				for (int i = 0; i < nActive; ++i) {
+					VoiceSegment<Outputs>::runJob(&segment, i);
+				}
 			}
+
+			if (newBlock && !amortised && blockNewSpectrum) bandPrevInput.copyFrom(bandInput);
+			segmentStart = segmentEnd;
 		}
-		inputBuffer += inputSamples;
-		stft += outputSamples;
+
+		storeInputHistory(inputs, inputSamples, std::max<int>(0, inputSamples - blockSamples()));
+		for (auto &voice : voices) voice.stft += outputSamples;
+		// If no voices are active, don't let the clock run away
+		validUntilIndex = std::max<int>(-1, validUntilIndex - outputSamples);
 		prevInputOffset -= inputSamples;
+		inputTime += inputSamples;
 	}
 
 	// Read the remaining output, providing no further input.  `outputSamples` should ideally be at least `.outputLatency()`
 	template<class Outputs>
 	void flush(Outputs &&outputs, int outputSamples) {
-		int plainOutput = std::min<int>(outputSamples, stft.windowSize());
-		int foldedBackOutput = std::min<int>(outputSamples, stft.windowSize() - plainOutput);
-		for (int c = 0; c < channels; ++c) {
-			auto &&outputChannel = outputs[c];
-			auto &&stftChannel = stft[c];
-			for (int i = 0; i < plainOutput; ++i) {
+		flushVoices(SingleVoice<Outputs>{outputs}, outputSamples);
+	}
+	template<class VoiceOutputs>
+	void flushVoices(VoiceOutputs &&voiceOutputs, int outputSamples) {
+		int tailSamples = blockSamples() + voices[0].stft.latency();
+		int plainOutput = std::min<int>(outputSamples, tailSamples);
+		int foldedBackOutput = std::min<int>(outputSamples, tailSamples - plainOutput);
+		finishBlock();
+		for (int v = 0; v < voiceCount(); ++v) {
+			if (!voices[v].active) continue;
+			auto &&outputs = voiceOutputs[v];
+			auto &voiceStft = voices[v].stft;
+			for (int c = 0; c < channels; ++c) {
+				auto &&outputChannel = outputs[c];
+				auto &&stftChannel = voiceStft[c];
 				// TODO: plain output should be gain-
-				outputChannel[i] = stftChannel[i];
-			}
-			for (int i = 0; i < foldedBackOutput; ++i) {
-				outputChannel[outputSamples - 1 - i] -= stftChannel[plainOutput + i];
-			}
-			for (int i = 0; i < plainOutput + foldedBackOutput; ++i) {
-				stftChannel[i] = 0;
+				stftChannel.read(plainOutput, outputChannel);
+				for (int i = 0; i < foldedBackOutput; ++i) {
+					outputChannel[outputSamples - 1 - i] -= stftChannel[plainOutput + i];
+				}
+				stftChannel.fill(plainOutput + foldedBackOutput, 0);
 			}
+			// Skip the output we just used/cleared
+			voiceStft += plainOutput + foldedBackOutput;
 		}
-		// Skip the output we just used/cleared
-		stft += plainOutput + foldedBackOutput;
+		validUntilIndex -= plainOutput + foldedBackOutput;
 		// Reset the phase-vocoder stuff, so the next block gets a fresh start
-		for (int c = 0; c < channels; ++c) {
-			auto channelBands = bandsForChannel(c);
-			for (int b = 0; b < bands; ++b) {
-				channelBands[b].prevInput = channelBands[b].prevOutput = 0;
-			}
-		}
+		bandPrevInput.clear();
+		for (auto &voice : voices) voice.prevOutput.clear();
 		flushed = true;
 	}
 private:
@@ -290,241 +421,661 @@ private:
 	int silenceCounter = 0;
 	bool silenceFirst = true;
 
-	Sample freqMultiplier = 1, freqTonalityLimit = 0.5;
-	std::function<Sample(Sample)> customFreqMap = nullptr;
+	template<class Outputs>
+	struct SingleVoice {
+		Outputs &outputs;
+		Outputs & operator[](int) {
+			return outputs;
+		}
+	};
 
-	signalsmith::spectral::STFT<Sample> stft{0, 1, 1};
 	signalsmith::delay::MultiBuffer<Sample> inputBuffer;
 	int channels = 0, bands = 0;
+	// Input samples since the last reset, at the start of the current call
+	long inputTime = 0;
 	int prevInputOffset = -1;
+	int validUntilIndex = -1; // kept in step with every voice's STFT
+	// Two windows of input for each channel (the block, and one interval before it), kept until they're analysed
 	std::vector<Sample> timeBuffer;
+	int timeBufferStride = 0;
+	struct TimeChannels {
+		Sample *data;
+		int stride;
+		Sample * operator[](int c) const {
+			return data + c*stride;
+		}
+	};
+	TimeChannels timeChannels(int window=0) {
+		return {timeBuffer.data() + window*channels*timeBufferStride, timeBufferStride};
+	}
 	bool didSeek = false, flushed = true;
 	Sample seekTimeFactor = 1;
 
-	std::vector<Complex> rotCentreSpectrum, rotPrevInterval;
+	// Values for each band, as a separate array for each channel.  There's (zeroed) padding at both ends, so interpolation can read slightly out of range without checking.
+	struct BandArray {
+		static constexpr int padding = 4;
+		int stride = 0;
+		std::vector<Sample> values;
+
+		static int strideFor(int nBands) {
+			return (nBands + 2*padding + 3)/4*4; // keep each channel's start aligned to 4 samples
+		}
+		void resize(int nChannels, int nBands) {
+			stride = strideFor(nBands);
+			values.assign(nChannels*stride, 0);
+		}
+		void reserve(int nChannels, int nBands) {
+			values.reserve(nChannels*strideFor(nBands));
+		}
+		void clear() {
+			values.assign(values.size(), 0);
+		}
+		Sample * operator[](int channel) {
+			return values.data() + channel*stride + padding;
+		}
+		const Sample * operator[](int channel) const {
+			return values.data() + channel*stride + padding;
+		}
+	};
+	// Complex band values, with the real/imaginary parts kept separate
+	struct ComplexBandArray {
+		BandArray real, imag;
+
+		void resize(int nChannels, int nBands) {
+			real.resize(nChannels, nBands);
+			imag.resize(nChannels, nBands);
+		}
+		void reserve(int nChannels, int nBands) {
+			real.reserve(nChannels, nBands);
+			imag.reserve(nChannels, nBands);
+		}
+		void clear() {
+			real.clear();
+			imag.clear();
+		}
+		void copyFrom(const ComplexBandArray &other) {
+			std::copy(other.real.values.begin(), other.real.values.end(), real.values.begin());
+			std::copy(other.imag.values.begin(), other.imag.values.end(), imag.values.begin());
+		}
+		// Multiplies every channel by a single-channel set of rotations
+		void rotate(const ComplexBandArray &rotation, int nChannels, int nBands) {
+			const Sample *rotReal = rotation.real[0], *rotImag = rotation.imag[0];
+			for (int c = 0; c < nChannels; ++c) {
+				Sample *r = real[c], *i = imag[c];
+				for (int b = 0; b < nBands; ++b) {
+					Sample newR = r[b]*rotReal[b] - i[b]*rotImag[b];
+					Sample newI = r[b]*rotImag[b] + i[b]*rotReal[b];
+					r[b] = newR;
+					i[b] = newI;
+				}
+			}
+		}
+	};
+
+	ComplexBandArray rotCentreSpectrum, rotPrevInterval;
 	Sample bandToFreq(Sample b) const {
-		return (b + Sample(0.5))/stft.fftSize();
+		return (b + Sample(0.5))/voices[0].stft.fftSize();
 	}
 	Sample freqToBand(Sample f) const {
-		return f*stft.fftSize() - Sample(0.5);
+		return f*voices[0].stft.fftSize() - Sample(0.5);
 	}
-	void timeShiftPhases(Sample shiftSamples, std::vector<Complex> &output) const {
+	void timeShiftPhases(Sample shiftSamples, ComplexBandArray &output) const {
+		Sample *real = output.real[0], *imag = output.imag[0];
 		for (int b = 0; b < bands; ++b) {
 			Sample phase = bandToFreq(b)*shiftSamples*Sample(-2*M_PI);
-			output[b] = {std::cos(phase), std::sin(phase)};
+			real[b] = std::cos(phase);
+			imag[b] = std::sin(phase);
 		}
 	}
 	
-	struct Band {
-		Complex input, prevInput{0};
-		Complex output, prevOutput{0};
-		Sample inputEnergy;
+	// Analysis results, shared between all voices
+	ComplexBandArray bandInput, bandPrevInput;
+	BandArray bandInputEnergy;
+
+	// Fractional band positions, split into a lower band and fractional part so that several arrays can be interpolated with the same position
+	struct BandPositions {
+		std::vector<int> low;
+		std::vector<Sample> fractional;
+		
+		void resize(int nBands) {
+			low.resize(nBands);
+			fractional.resize(nBands);
+		}
+		void reserve(int nBands) {
+			low.reserve(nBands);
+			fractional.reserve(nBands);
+		}
+		// Out-of-range positions are clamped so they only read the (zeroed) padding
+		SIGNALSMITH_INLINE void set(int b, Sample index, int nBands) {
+			Sample clamped = std::min<Sample>(nBands, std::max<Sample>(-2, index));
+			int lowIndex = int(clamped);
+			lowIndex -= (Sample(lowIndex) > clamped); // floor(), without the function call
+			low[b] = lowIndex;
+			fractional[b] = clamped - lowIndex;
+		}
+		SIGNALSMITH_INLINE Sample interpolate(const Sample *values, int b) const {
+			Sample lowValue = values[low[b]], highValue = values[low[b] + 1];
+			return lowValue + (highValue - lowValue)*fractional[b];
+		}
 	};
-	std::vector<Band> channelBands;
-	Band * bandsForChannel(int channel) {
-		return channelBands.data() + channel*bands;
-	}
-	template<Complex Band::*member>
-	Complex getBand(int channel, int index) {
-		if (index < 0 || index >= bands) return 0;
-		return channelBands[index + channel*bands].*member;
-	}
-	template<Complex Band::*member>
-	Complex getFractional(int channel, int lowIndex, Sample fractional) {
-		Complex low = getBand<member>(channel, lowIndex);
-		Complex high = getBand<member>(channel, lowIndex + 1);
-		return low + (high - low)*fractional;
-	}
-	template<Complex Band::*member>
-	Complex getFractional(int channel, Sample inputIndex) {
-		int lowIndex = std::floor(inputIndex);
-		Sample fracIndex = inputIndex - lowIndex;
-		return getFractional<member>(channel, lowIndex, fracIndex);
-	}
-	template<Sample Band::*member>
-	Sample getBand(int channel, int index) {
-		if (index < 0 || index >= bands) return 0;
-		return channelBands[index + channel*bands].*member;
-	}
-	template<Sample Band::*member>
-	Sample getFractional(int channel, int lowIndex, Sample fractional) {
-		Sample low = getBand<member>(channel, lowIndex);
-		Sample high = getBand<member>(channel, lowIndex + 1);
-		return low + (high - low)*fractional;
-	}
-	template<Sample Band::*member>
-	Sample getFractional(int channel, Sample inputIndex) {
-		int lowIndex = std::floor(inputIndex);
-		Sample fracIndex = inputIndex - lowIndex;
-		return getFractional<member>(channel, lowIndex, fracIndex);
-	}
+	static_assert(BandArray::padding >= 2, "interpolation reads up to two bands beyond each end");
+	std::vector<Sample> peakBands;
+	std::vector<Sample> energy, smoothedEnergy;
 
 	struct Peak {
 		Sample input, output;
 	};
-	std::vector<Peak> peaks;
-	std::vector<Sample> energy, smoothedEnergy;
 	struct PitchMapPoint {
 		Sample inputBin, freqGrad;
 	};
-	std::vector<PitchMapPoint> outputMap;
 	
-	struct Prediction {
-		Sample energy = 0;
-		Complex input;
-		Complex shortVerticalTwist, longVerticalTwist;
-
-		Complex makeOutput(Complex phase) {
-			Sample phaseNorm = std::norm(phase);
-			if (phaseNorm <= noiseFloor) {
-				phase = input; // prediction is too weak, fall back to the input
-				phaseNorm = std::norm(input) + noiseFloor;
+	// Scales the phase to match the energy, falling back to the input if the phase is too weak
+	SIGNALSMITH_INLINE static void makeOutput(Sample energy, Sample inputReal, Sample inputImag, Sample &phaseReal, Sample &phaseImag) {
+		Sample phaseNorm = phaseReal*phaseReal + phaseImag*phaseImag;
+		if (phaseNorm <= noiseFloor) {
+			phaseReal = inputReal;
+			phaseImag = inputImag;
+			phaseNorm = inputReal*inputReal + inputImag*inputImag + noiseFloor;
+		}
+		Sample scale = std::sqrt(energy/phaseNorm);
+		phaseReal *= scale;
+		phaseImag *= scale;
+	}
+
+	/* Uniform random numbers for the randomised time-factors, from several xorshift32 streams side-by-side.  Each batch is a few independent shifts and XORs, which vectorise.
+	The same seed always gives the same numbers, so renders are reproducible. */
+	struct RandomBatch {
+		static constexpr int lanes = 8;
+		uint32_t state[lanes];
+
+		void seed(long seed) {
+			// splitmix64, so that neighbouring seeds (one per voice) give unrelated streams
+			uint64_t x = uint64_t(seed);
+			for (int l = 0; l < lanes; ++l) {
+				x += 0x9E3779B97F4A7C15ull;
+				uint64_t z = x;
+				z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ull;
+				z = (z ^ (z >> 27))*0x94D049BB133111EBull;
+				state[l] = uint32_t(z ^ (z >> 31)) | 1; // xorshift never leaves 0
+			}
+		}
+
+		/// Fills `output` with values uniformly distributed in `[low, high)`
+		void fill(Sample *output, int length, Sample low, Sample high) {
+			Sample scale = (high - low)/Sample(1 << 24);
+			for (int i = 0; i < length; i += lanes) {
+				for (int l = 0; l < lanes; ++l) {
+					uint32_t x = state[l];
+					x ^= x << 13;
+					x ^= x >> 17;
+					x ^= x << 5;
+					state[l] = x;
+				}
+				int count = std::min(lanes, length - i);
+				for (int l = 0; l < count; ++l) {
+					output[i + l] = low + Sample(state[l] >> 8)*scale; // top 24 bits, which are exact as a float
+				}
 			}
-			return phase*std::sqrt(energy/phaseNorm);
 		}
 	};
-	std::vector<Prediction> channelPredictions;
-	Prediction * predictionsForChannel(int c) {
-		return channelPredictions.data() + c*bands;
-	}
+
+	// Synthesis state, separate for each voice
+	struct Voice {
+		signalsmith::spectral::STFT<Sample> stft{0, 1, 1};
+		bool active = true;
+
+		Sample freqMultiplier = 1, freqTonalityLimit = 0.5;
+		std::function<Sample(Sample)> customFreqMap = nullptr;
+
+		ComplexBandArray output, prevOutput;
+		std::vector<Peak> peaks;
+		std::vector<PitchMapPoint> outputMap;
+		// The frequency map (as bands) sampled at every band, plus one past the end
+		std::vector<Sample> bandMap;
+		// The transpose before the last change, kept so that switching back to it doesn't have to sample it again
+		std::vector<Sample> previousBandMap;
+		Sample previousMultiplier = 1, previousTonalityLimit = 0.5;
+		bool previousValid = false;
+
+		// Transposes waiting for their processing time (in input samples since the last reset)
+		struct ScheduledTranspose {
+			long inputTime;
+			Sample multiplier, tonalityLimit;
+		};
+		static constexpr int maxScheduled = 8;
+		std::array<ScheduledTranspose, maxScheduled> scheduled;
+		int scheduledCount = 0;
+		// Phase-vocoder predictions
+		BandArray predictionEnergy;
+		ComplexBandArray predictionInput, shortVerticalTwist, longVerticalTwist;
+		RandomBatch random;
+		// Scratch space, per-voice so that voices can be processed in parallel
+		BandPositions predictionPositions, shortVerticalPositions, longVerticalPositions;
+		std::vector<Sample> binTimeFactors;
+		std::vector<int> maxChannels;
+		// Progress through the spectral processing for the current block, which (when amortised) is spread over `spectrumSamples`, starting `spectrumStart` into the interval
+		int spectrumStep = 0, spectrumStart = 0, spectrumSamples = 1;
+
+		void clearPredictions() {
+			predictionEnergy.clear();
+			predictionInput.clear();
+			shortVerticalTwist.clear();
+			longVerticalTwist.clear();
+		}
 	
-	std::default_random_engine randomEngine;
+		bool mapsFreqs() const {
+			return customFreqMap || freqMultiplier != 1;
+		}
+		Sample mapFreq(Sample freq) const {
+			if (customFreqMap) return customFreqMap(freq);
+			if (freq > freqTonalityLimit) {
+				Sample diff = freq - freqTonalityLimit;
+				return freqTonalityLimit*freqMultiplier + diff;
+			}
+			return freq*freqMultiplier;
+		}
+	};
+	long seed;
+	std::vector<Voice> voices;
+	std::vector<int> activeVoices;
+	bool amortised = false;
+	VoiceRunner voiceRunner;
 
-	void processSpectrum(bool newSpectrum, Sample timeFactor) {
-		timeFactor = std::max<Sample>(timeFactor, 1/maxCleanStretch);
-		bool randomTimeFactor = (timeFactor > maxCleanStretch);
-		std::uniform_real_distribution<Sample> timeFactorDist(maxCleanStretch*2*randomTimeFactor - timeFactor, timeFactor);
-		
+	// Set up by the shared processing for a new block, and used by each voice
+	bool blockNewSpectrum = false;
+	Sample blockTimeFactor = 1, blockSmoothingBins = 1;
+	// The shared processing, as steps: each analysed window (one per channel), then `processSpectrum()`.  When amortised, these are spread over the first `analysisSamples` of the interval.
+	int blockWindows = 0, analysisStep = 0, analysisSteps = 0, analysisSamples = 1;
+	// Whether the block still has to be finished (see `finishBlock()`)
+	bool blockPending = false;
+
+	// One voice's share of a segment of output (between new blocks)
+	template<class VoiceOutputs>
+	void processVoiceSegment(int v, VoiceOutputs &voiceOutputs, int segmentStart, int segmentEnd) {
+		Voice &voice = voices[v];
+		auto &&outputs = voiceOutputs[v];
+		if (segmentEnd <= segmentStart) return;
+		if (amortised) {
+			// Keep up with our turn at the spectral processing (which only starts once the shared steps are done)
+			int elapsed = segmentEnd - (validUntilIndex + 1 - intervalSamples()) - voice.spectrumStart;
+			if (elapsed > 0) {
+				int totalSteps = voiceSpectrumSteps();
+				processVoiceSpectrum(voice, std::min(totalSteps, (totalSteps*elapsed + voice.spectrumSamples - 1)/voice.spectrumSamples));
+			}
+		}
+		// Segments never cross the start of a block, and amortised synthesis only writes ahead of the current block, so the whole segment can be made valid at once and then copied out
+		voice.stft.ensureValid(segmentEnd - 1, [&](int) {
+			synthesisSpectrum(voice);
+		});
+
+		for (int c = 0; c < channels; ++c) {
+			auto &&outputChannel = outputs[c];
+			auto spans = voice.stft[c].spans(segmentStart, segmentEnd - segmentStart);
+			for (int i = 0; i < spans.firstLength; ++i) {
+				outputChannel[segmentStart + i] = spans.first[i];
+			}
+			for (int i = 0; i < spans.secondLength; ++i) {
+				outputChannel[segmentStart + spans.firstLength + i] = spans.second[i];
+			}
+		}
+	}
+	// Does a voice's spectral processing for the block, and fills its STFT's spectrum with the result
+	void synthesisSpectrum(Voice &voice) {
+		processVoiceSpectrum(voice, voiceSpectrumSteps());
+
+		const Sample *rotReal = rotCentreSpectrum.real[0], *rotImag = rotCentreSpectrum.imag[0];
+		for (int c = 0; c < channels; ++c) {
+			const Sample *outputReal = voice.output.real[c], *outputImag = voice.output.imag[c];
+			auto &&spectrumBands = voice.stft.spectrum[c];
+			for (int b = 0; b < bands; ++b) {
+				spectrumBands[b] = {
+					rotReal[b]*outputReal[b] + rotImag[b]*outputImag[b],
+					rotReal[b]*outputImag[b] - rotImag[b]*outputReal[b]
+				};
+			}
+		}
+	}
+	template<class VoiceOutputs>
+	struct VoiceSegment {
+		SignalsmithStretch *stretch;
+		VoiceOutputs *voiceOutputs;
+		int start, end;
+
+		static void runJob(void *context, int job) {
+			auto &segment = *static_cast<VoiceSegment *>(context);
+			auto *stretch = segment.stretch;
+			stretch->processVoiceSegment(stretch->activeVoices[job], *segment.voiceOutputs, segment.start, segment.end);
+		}
+	};
+
+	// Stores input samples `[startIndex, inputSamples)` in the history buffer, then moves it along past this input
+	template<class Inputs>
+	void storeInputHistory(Inputs &&inputs, int inputSamples, int startIndex) {
+		for (int c = 0; c < channels; ++c) {
+			auto &&inputChannel = inputs[c];
+			auto spans = inputBuffer[c].spans(startIndex, inputSamples - startIndex);
+			for (int i = 0; i < spans.firstLength; ++i) {
+				spans.first[i] = inputChannel[startIndex + i];
+			}
+			for (int i = 0; i < spans.secondLength; ++i) {
+				spans.second[i] = inputChannel[startIndex + spans.firstLength + i];
+			}
+		}
+		inputBuffer += inputSamples;
+	}
+
+	/* Starts the block at `outputOffset`: this copies the input windows it needs (since the input is only around for this call), and sets up the shared processing.
+	Without amortisation that all happens straight away, otherwise the previous block is finished off first. */
+	template<class Inputs>
+	void processBlock(Inputs &&inputs, int inputSamples, int outputSamples, int outputOffset, int nActive) {
+		auto &stft = voices[0].stft; // analysis is shared, so any voice's STFT will do
+		if (amortised) finishBlock();
+
+		// Time to process a spectrum!  Where should it come from in the input?
+		int inputOffset = std::round(outputOffset*Sample(inputSamples)/outputSamples) - stft.windowSize();
+		int inputInterval = inputOffset - prevInputOffset;
+		prevInputOffset = inputOffset;
+
+		bool newSpectrum = didSeek || (inputInterval > 0);
+		blockWindows = 0;
 		if (newSpectrum) {
-			for (int c = 0; c < channels; ++c) {
-				auto bins = bandsForChannel(c);
-				for (int b = 0; b < bands; ++b) {
-					auto &bin = bins[b];
-					bin.prevOutput = signalsmith::perf::mul(bin.prevOutput, rotPrevInterval[b]);
-					bin.prevInput = signalsmith::perf::mul(bin.prevInput, rotPrevInterval[b]);
+			copyInputWindow(inputs, inputOffset, timeChannels(blockWindows++));
+			flushed = false; // TODO: first block after a flush should be gain-compensated
+
+			if (didSeek || inputInterval != stft.interval()) { // make sure the previous input is the correct distance in the past
+				copyInputWindow(inputs, inputOffset - stft.interval(), timeChannels(blockWindows++));
+			}
+		}
+		
+		Sample timeFactor = didSeek ? seekTimeFactor : stft.interval()/std::max<Sample>(1, inputInterval);
+		// This block is centred on the processing time, which is `.inputLatency()` behind the end of its input
+		applyScheduledTransposes(inputTime + inputOffset + stft.windowSize() - inputLatency());
+		blockNewSpectrum = newSpectrum;
+		blockTimeFactor = timeFactor;
+		didSeek = false;
+
+		analysisStep = 0;
+		analysisSteps = blockWindows*channels + 1;
+		for (auto &voice : voices) voice.spectrumStep = 0;
+		if (amortised) {
+			// Split the interval between the shared steps and the voices, roughly in proportion to their cost (in FFTs: a voice's spectral processing costs about two per channel, and its synthesis one)
+			int interval = stft.interval(), voiceCost = 3*channels;
+			analysisSamples = std::max(1, std::min(interval - 1, interval*analysisSteps/(analysisSteps + nActive*voiceCost)));
+			// The voices take turns at their spectral processing, each starting its synthesis once that's done
+			int turnSamples = (interval - analysisSamples)/nActive;
+			for (int i = 0; i < nActive; ++i) {
+				Voice &voice = voices[activeVoices[i]];
+				voice.spectrumStart = analysisSamples + i*turnSamples;
+				voice.spectrumSamples = std::max(1, turnSamples*2/3);
+				voice.stft.setSpectrumDelay(voice.spectrumStart + voice.spectrumSamples - 1);
+			}
+			blockPending = true;
+		} else {
+			analyseSteps(analysisSteps);
+		}
+	}
+
+	// Copies one window of input for each channel, starting at `inputOffset` in this call's input (so negative offsets read from the history)
+	template<class Inputs>
+	void copyInputWindow(Inputs &&inputs, int inputOffset, TimeChannels time) {
+		int windowSize = blockSamples();
+		for (int c = 0; c < channels; ++c) {
+			// Copy from the history buffer, if needed
+			(inputBuffer[c] + inputOffset).read(std::max<int>(0, std::min(-inputOffset, windowSize)), time[c]);
+			// Copy the rest from the input
+			auto &&inputChannel = inputs[c];
+			for (int i = std::max<int>(0, -inputOffset); i < windowSize; ++i) {
+				time[c][i] = inputChannel[i + inputOffset];
+			}
+		}
+	}
+
+	// Runs the block's shared processing up to a particular step
+	void analyseSteps(int untilStep) {
+		auto &stft = voices[0].stft;
+		while (analysisStep < untilStep) {
+			int window = analysisStep/channels, c = analysisStep%channels;
+			if (window < blockWindows) {
+				auto &output = (window == 0) ? bandInput : bandPrevInput;
+				auto time = timeChannels(window);
+				if (c == 0 && analysisStep + channels <= untilStep) {
+					// The whole window is due, so all its channels are analysed in one call
+					stft.analyse(time);
+					for (; c < channels; ++c) storeInput(stft.spectrum[c], output.real[c], output.imag[c]);
+					analysisStep += channels;
+					continue;
 				}
+				stft.analyse(c, time[c]);
+				storeInput(stft.spectrum[c], output.real[c], output.imag[c]);
+			} else {
+				processSpectrum(blockNewSpectrum, blockTimeFactor);
 			}
+			++analysisStep;
+		}
+	}
+
+	// Does whatever amortised processing is still due for the current block, so the next one can start (or the output can be flushed)
+	void finishBlock() {
+		if (!blockPending) return;
+		analyseSteps(analysisSteps);
+		for (auto &voice : voices) {
+			if (voice.active) voice.stft.flushPending([&](int) {
+				synthesisSpectrum(voice);
+			});
 		}
+		// Every voice has used the previous input now
+		if (blockNewSpectrum) bandPrevInput.copyFrom(bandInput);
+		blockPending = false;
+	}
 
-		Sample smoothingBins = Sample(stft.fftSize())/stft.interval();
-		int longVerticalStep = std::round(smoothingBins);
-		if (customFreqMap || freqMultiplier != 1) {
+	// Rotates an analysed spectrum to be centred on the block, and splits it into real/imaginary parts
+	template<class Spectrum>
+	void storeInput(Spectrum &&spectrumBands, Sample *real, Sample *imag) {
+		const Sample *rotReal = rotCentreSpectrum.real[0], *rotImag = rotCentreSpectrum.imag[0];
+		for (int b = 0; b < bands; ++b) {
+			Complex bin = spectrumBands[b];
+			real[b] = bin.real()*rotReal[b] - bin.imag()*rotImag[b];
+			imag[b] = bin.real()*rotImag[b] + bin.imag()*rotReal[b];
+		}
+	}
+
+	void processSpectrum(bool newSpectrum, Sample timeFactor) {
+		timeFactor = std::max<Sample>(timeFactor, 1/maxCleanStretch);
+		
+		if (newSpectrum) bandPrevInput.rotate(rotPrevInterval, channels, bands);
+
+		Sample smoothingBins = Sample(voices[0].stft.fftSize())/voices[0].stft.interval();
+		bool anyFreqMap = false;
+		for (auto &voice : voices) anyFreqMap = anyFreqMap || (voice.active && voice.mapsFreqs());
+		if (anyFreqMap) {
 			findPeaks(smoothingBins);
-			updateOutputMap();
 		} else { // we're not pitch-shifting, so no need to find peaks etc.
 			for (int c = 0; c < channels; ++c) {
-				Band *bins = bandsForChannel(c);
+				const Sample *inputReal = bandInput.real[c], *inputImag = bandInput.imag[c];
+				Sample *inputEnergy = bandInputEnergy[c];
 				for (int b = 0; b < bands; ++b) {
-					bins[b].inputEnergy = std::norm(bins[b].input);
+					inputEnergy[b] = inputReal[b]*inputReal[b] + inputImag[b]*inputImag[b];
 				}
 			}
-			for (int b = 0; b < bands; ++b) {
-				outputMap[b] = {Sample(b), 1};
-			}
 		}
 
-		// Preliminary output prediction from phase-vocoder
-		for (int c = 0; c < channels; ++c) {
-			Band *bins = bandsForChannel(c);
-			auto *predictions = predictionsForChannel(c);
-			for (int b = 0; b < bands; ++b) {
-				auto mapPoint = outputMap[b];
-				int lowIndex = std::floor(mapPoint.inputBin);
-				Sample fracIndex = mapPoint.inputBin - lowIndex;
-
-				Prediction &prediction = predictions[b];
-				Sample prevEnergy = prediction.energy;
-				prediction.energy = getFractional<&Band::inputEnergy>(c, lowIndex, fracIndex);
-				prediction.energy *= std::max<Sample>(0, mapPoint.freqGrad); // scale the energy according to local stretch factor
-				prediction.input = getFractional<&Band::input>(c, lowIndex, fracIndex);
-
-				auto &outputBin = bins[b];
-				Complex prevInput = getFractional<&Band::prevInput>(c, lowIndex, fracIndex);
-				Complex freqTwist = signalsmith::perf::mul<true>(prediction.input, prevInput);
-				Complex phase = signalsmith::perf::mul(outputBin.prevOutput, freqTwist);
-				outputBin.output = phase/(std::max(prevEnergy, prediction.energy) + noiseFloor);
-
-				if (b > 0) {
-					Sample binTimeFactor = randomTimeFactor ? timeFactorDist(randomEngine) : timeFactor;
-					Complex downInput = getFractional<&Band::input>(c, mapPoint.inputBin - binTimeFactor);
-					prediction.shortVerticalTwist = signalsmith::perf::mul<true>(prediction.input, downInput);
-					if (b >= longVerticalStep) {
-						Complex longDownInput = getFractional<&Band::input>(c, mapPoint.inputBin - longVerticalStep*binTimeFactor);
-						prediction.longVerticalTwist = signalsmith::perf::mul<true>(prediction.input, longDownInput);
-					} else {
-						prediction.longVerticalTwist = 0;
-					}
+		// Each voice does the rest when it synthesises the block (see `processVoiceSegment()`)
+		blockNewSpectrum = newSpectrum;
+		blockTimeFactor = timeFactor;
+		blockSmoothingBins = smoothingBins;
+	}
+
+	// A voice's spectral processing is done in steps, so that amortised processing can spread it out: setting up the frequency map, the phase-vocoder prediction for each channel, the vertical phase-differences for each channel, then the re-prediction a range of bands at a time
+	static constexpr int repredictBands = 512;
+	int voiceSpectrumSteps() const {
+		return 1 + 2*channels + (bands + repredictBands - 1)/repredictBands;
+	}
+
+	// Runs the voice's spectral processing for the current block, up to a particular step
+	void processVoiceSpectrum(Voice &voice, int untilStep) {
+		bool randomTimeFactor = (blockTimeFactor > maxCleanStretch);
+		Sample timeFactor = blockTimeFactor, randomTimeFactorLow = maxCleanStretch*2 - timeFactor;
+		int longVerticalStep = std::round(blockSmoothingBins);
+		int longStart = std::min(std::max(longVerticalStep, 1), bands);
+
+		auto &outputMap = voice.outputMap;
+		auto &predPositions = voice.predictionPositions;
+		auto &binTimeFactors = voice.binTimeFactors;
+		auto &maxChannels = voice.maxChannels;
+		auto &shortPositions = voice.shortVerticalPositions, &longPositions = voice.longVerticalPositions;
+
+		for (; voice.spectrumStep < untilStep; ++voice.spectrumStep) {
+			int step = voice.spectrumStep;
+			if (step == 0) {
+				if (blockNewSpectrum) voice.prevOutput.rotate(rotPrevInterval, channels, bands);
+
+				if (voice.mapsFreqs()) {
+					mapPeaks(voice);
+					updateOutputMap(voice);
 				} else {
-					prediction.shortVerticalTwist = prediction.longVerticalTwist = 0;
+					for (int b = 0; b < bands; ++b) {
+						outputMap[b] = {Sample(b), 1};
+					}
 				}
-			}
-		}
 
-		// Re-predict using phase differences between frequencies
-		for (int b = 0; b < bands; ++b) {
-			// Find maximum-energy channel and calculate that
-			int maxChannel = 0;
-			Sample maxEnergy = predictionsForChannel(0)[b].energy;
-			for (int c = 1; c < channels; ++c) {
-				Sample e = predictionsForChannel(c)[b].energy;
-				if (e > maxEnergy) {
-					maxChannel = c;
-					maxEnergy = e;
+				for (int b = 0; b < bands; ++b) {
+					predPositions.set(b, outputMap[b].inputBin, bands);
 				}
-			}
+			} else if (step <= channels) {
+				// Preliminary output prediction from phase-vocoder
+				int c = step - 1;
+				Sample *outputReal = voice.output.real[c], *outputImag = voice.output.imag[c];
+				const Sample *prevOutputReal = voice.prevOutput.real[c], *prevOutputImag = voice.prevOutput.imag[c];
+				Sample *predEnergy = voice.predictionEnergy[c];
+				Sample *predReal = voice.predictionInput.real[c], *predImag = voice.predictionInput.imag[c];
+				const Sample *inputEnergy = bandInputEnergy[c];
+				const Sample *inputReal = bandInput.real[c], *inputImag = bandInput.imag[c];
+				const Sample *prevInputReal = bandPrevInput.real[c], *prevInputImag = bandPrevInput.imag[c];
+				for (int b = 0; b < bands; ++b) {
+					Sample prevEnergy = predEnergy[b];
+					Sample energy = predPositions.interpolate(inputEnergy, b)*std::max<Sample>(0, outputMap[b].freqGrad); // scale the energy according to local stretch factor
+					predEnergy[b] = energy;
 
-			auto *predictions = predictionsForChannel(maxChannel);
-			auto &prediction = predictions[b];
-			auto *bins = bandsForChannel(maxChannel);
-			auto &outputBin = bins[b];
+					// conj(prevInput)*input, then rotate the previous output by that
+					Sample inR = predPositions.interpolate(inputReal, b), inI = predPositions.interpolate(inputImag, b);
+					Sample prevInR = predPositions.interpolate(prevInputReal, b), prevInI = predPositions.interpolate(prevInputImag, b);
+					predReal[b] = inR;
+					predImag[b] = inI;
+					Sample twistR = prevInR*inR + prevInI*inI;
+					Sample twistI = prevInR*inI - prevInI*inR;
+					Sample phaseR = prevOutputReal[b]*twistR - prevOutputImag[b]*twistI;
+					Sample phaseI = prevOutputReal[b]*twistI + prevOutputImag[b]*twistR;
+					Sample norm = std::max(prevEnergy, energy) + noiseFloor;
+					outputReal[b] = phaseR/norm;
+					outputImag[b] = phaseI/norm;
+				}
+			} else if (step <= 2*channels) {
+				// Vertical (between-band) phase differences, using the input a (possibly randomised) time-factor below each band
+				int c = step - 1 - channels;
+				// The positions only change between channels if the time-factor is randomised
+				if (c == 0 || randomTimeFactor) {
+					if (randomTimeFactor) {
+						voice.random.fill(binTimeFactors.data() + 1, bands - 1, randomTimeFactorLow, timeFactor);
+					} else {
+						for (int b = 1; b < bands; ++b) {
+							binTimeFactors[b] = timeFactor;
+						}
+					}
+					for (int b = 1; b < bands; ++b) {
+						shortPositions.set(b, outputMap[b].inputBin - binTimeFactors[b], bands);
+					}
+					for (int b = longStart; b < bands; ++b) {
+						longPositions.set(b, outputMap[b].inputBin - longVerticalStep*binTimeFactors[b], bands);
+					}
+				}
+				const Sample *predReal = voice.predictionInput.real[c], *predImag = voice.predictionInput.imag[c];
+				const Sample *inputReal = bandInput.real[c], *inputImag = bandInput.imag[c];
 
-			Complex phase = 0;
+				Sample *shortReal = voice.shortVerticalTwist.real[c], *shortImag = voice.shortVerticalTwist.imag[c];
+				shortReal[0] = shortImag[0] = 0;
+				for (int b = 1; b < bands; ++b) {
+					Sample downR = shortPositions.interpolate(inputReal, b), downI = shortPositions.interpolate(inputImag, b);
+					shortReal[b] = downR*predReal[b] + downI*predImag[b];
+					shortImag[b] = downR*predImag[b] - downI*predReal[b];
+				}
 
-			// Upwards vertical steps
-			if (b > 0) {
-				auto &downBin = bins[b - 1];
-				phase += signalsmith::perf::mul(downBin.output, prediction.shortVerticalTwist);
-				
-				if (b >= longVerticalStep) {
-					auto &longDownBin = bins[b - longVerticalStep];
-					phase += signalsmith::perf::mul(longDownBin.output, prediction.longVerticalTwist);
+				Sample *longReal = voice.longVerticalTwist.real[c], *longImag = voice.longVerticalTwist.imag[c];
+				for (int b = 0; b < longStart; ++b) {
+					longReal[b] = longImag[b] = 0;
 				}
-			}
-			// Downwards vertical steps
-			if (b < bands - 1) {
-				auto &upPrediction = predictions[b + 1];
-				auto &upBin = bins[b + 1];
-				phase += signalsmith::perf::mul<true>(upBin.output, upPrediction.shortVerticalTwist);
-				
-				if (b < bands - longVerticalStep) {
-					auto &longUpPrediction = predictions[b + longVerticalStep];
-					auto &longUpBin = bins[b + longVerticalStep];
-					phase += signalsmith::perf::mul<true>(longUpBin.output, longUpPrediction.longVerticalTwist);
+				for (int b = longStart; b < bands; ++b) {
+					Sample downR = longPositions.interpolate(inputReal, b), downI = longPositions.interpolate(inputImag, b);
+					longReal[b] = downR*predReal[b] + downI*predImag[b];
+					longImag[b] = downR*predImag[b] - downI*predReal[b];
+				}
+			} else {
+				int startBand = (step - 1 - 2*channels)*repredictBands, endBand = std::min(bands, startBand + repredictBands);
+				if (startBand == 0) {
+					// Find the maximum-energy channel for each band
+					for (int b = 0; b < bands; ++b) maxChannels[b] = 0;
+					for (int c = 1; c < channels; ++c) {
+						const Sample *predEnergy = voice.predictionEnergy[c];
+						for (int b = 0; b < bands; ++b) {
+							maxChannels[b] = (predEnergy[b] > voice.predictionEnergy[maxChannels[b]][b]) ? c : maxChannels[b];
+						}
+					}
 				}
-			}
 
-			outputBin.output = prediction.makeOutput(phase);
-			
-			// All other bins are locked in phase
-			for (int c = 0; c < channels; ++c) {
-				if (c != maxChannel) {
-					auto &channelBin = bandsForChannel(c)[b];
-					auto &channelPrediction = predictionsForChannel(c)[b];
+				// Re-predict using phase differences between frequencies
+				for (int b = startBand; b < endBand; ++b) {
+					int maxChannel = maxChannels[b];
+					Sample *outputReal = voice.output.real[maxChannel], *outputImag = voice.output.imag[maxChannel];
+					const Sample *shortReal = voice.shortVerticalTwist.real[maxChannel], *shortImag = voice.shortVerticalTwist.imag[maxChannel];
+					const Sample *longReal = voice.longVerticalTwist.real[maxChannel], *longImag = voice.longVerticalTwist.imag[maxChannel];
+					Sample predReal = voice.predictionInput.real[maxChannel][b], predImag = voice.predictionInput.imag[maxChannel][b];
+
+					Sample phaseR = 0, phaseI = 0;
+
+					// Upwards vertical steps
+					if (b > 0) {
+						phaseR += outputReal[b - 1]*shortReal[b] - outputImag[b - 1]*shortImag[b];
+						phaseI += outputReal[b - 1]*shortImag[b] + outputImag[b - 1]*shortReal[b];
+						
+						if (b >= longVerticalStep) {
+							int lb = b - longVerticalStep;
+							phaseR += outputReal[lb]*longReal[b] - outputImag[lb]*longImag[b];
+							phaseI += outputReal[lb]*longImag[b] + outputImag[lb]*longReal[b];
+						}
+					}
+					// Downwards vertical steps
+					if (b < bands - 1) {
+						int ub = b + 1;
+						phaseR += shortReal[ub]*outputReal[ub] + shortImag[ub]*outputImag[ub];
+						phaseI += shortReal[ub]*outputImag[ub] - shortImag[ub]*outputReal[ub];
+						
+						if (b < bands - longVerticalStep) {
+							int lub = b + longVerticalStep;
+							phaseR += longReal[lub]*outputReal[lub] + longImag[lub]*outputImag[lub];
+							phaseI += longReal[lub]*outputImag[lub] - longImag[lub]*outputReal[lub];
+						}
+					}
+
+					makeOutput(voice.predictionEnergy[maxChannel][b], predReal, predImag, phaseR, phaseI);
+					outputReal[b] = phaseR;
+					outputImag[b] = phaseI;
 					
-					Complex channelTwist = signalsmith::perf::mul<true>(channelPrediction.input, prediction.input);
-					Complex channelPhase = signalsmith::perf::mul(outputBin.output, channelTwist);
-					channelBin.output = channelPrediction.makeOutput(channelPhase);
+					// All other bins are locked in phase
+					for (int c = 0; c < channels; ++c) {
+						if (c == maxChannel) continue;
+						Sample channelPredReal = voice.predictionInput.real[c][b], channelPredImag = voice.predictionInput.imag[c][b];
+						// conj(prediction)*channelPrediction, then rotate the max channel's output by that
+						Sample twistR = predReal*channelPredReal + predImag*channelPredImag;
+						Sample twistI = predReal*channelPredImag - predImag*channelPredReal;
+						Sample channelR = phaseR*twistR - phaseI*twistI;
+						Sample channelI = phaseR*twistI + phaseI*twistR;
+						makeOutput(voice.predictionEnergy[c][b], channelPredReal, channelPredImag, channelR, channelI);
+						voice.output.real[c][b] = channelR;
+						voice.output.imag[c][b] = channelI;
+					}
 				}
-			}
-		}
 
-		if (newSpectrum) {
-			for (auto &bin : channelBands) {
-				bin.prevOutput = bin.output;
-				bin.prevInput = bin.input;
+				if (endBand == bands) voice.prevOutput.copyFrom(voice.output);
 			}
-		} else {
-			for (auto &bin : channelBands) bin.prevOutput = bin.output;
 		}
 	}
 	
@@ -533,10 +1084,11 @@ private:
 		Sample smoothingSlew = 1/(1 + smoothingBins*Sample(0.5));
 		for (auto &e : energy) e = 0;
 		for (int c = 0; c < channels; ++c) {
-			Band *bins = bandsForChannel(c);
+			const Sample *inputReal = bandInput.real[c], *inputImag = bandInput.imag[c];
+			Sample *inputEnergy = bandInputEnergy[c];
 			for (int b = 0; b < bands; ++b) {
-				Sample e = std::norm(bins[b].input);
-				bins[b].inputEnergy = e; // Used for interpolating prediction energy
+				Sample e = inputReal[b]*inputReal[b] + inputImag[b]*inputImag[b];
+				inputEnergy[b] = e; // Used for interpolating prediction energy
 				energy[b] += e;
 			}
 		}
@@ -556,20 +1108,11 @@ private:
 		}
 	}
 	
-	Sample mapFreq(Sample freq) const {
-		if (customFreqMap) return customFreqMap(freq);
-		if (freq > freqTonalityLimit) {
-			Sample diff = freq - freqTonalityLimit;
-			return freqTonalityLimit*freqMultiplier + diff;
-		}
-		return freq*freqMultiplier;
-	}
-	
 	// Identifies spectral peaks using energy across all channels
 	void findPeaks(Sample smoothingBins) {
 		smoothEnergy(smoothingBins);
 
-		peaks.resize(0);
+		peakBands.resize(0);
 		
 		int start = 0;
 		while (start < bands) {
@@ -581,9 +1124,7 @@ private:
 					energySum += energy[end];
 					++end;
 				}
-				Sample avgBand = bandSum/energySum;
-				Sample avgFreq = bandToFreq(avgBand);
-				peaks.emplace_back(Peak{avgBand, freqToBand(mapFreq(avgFreq))});
+				peakBands.push_back(bandSum/energySum);
 
 				start = end;
 			}
@@ -591,7 +1132,62 @@ private:
 		}
 	}
 	
-	void updateOutputMap() {
+	void applyTranspose(Voice &voice, Sample multiplier, Sample tonalityLimit) {
+		Sample freqTonalityLimit = 1;
+		if (tonalityLimit > 0) {
+			freqTonalityLimit = tonalityLimit/std::sqrt(multiplier); // compromise between input and output limits
+		}
+		if (!voice.customFreqMap && multiplier == voice.freqMultiplier && freqTonalityLimit == voice.freqTonalityLimit) return;
+
+		bool wasPrevious = voice.previousValid && multiplier == voice.previousMultiplier && freqTonalityLimit == voice.previousTonalityLimit;
+		// The current map becomes the previous one (custom maps aren't kept, since they can't be compared)
+		std::swap(voice.bandMap, voice.previousBandMap);
+		voice.previousMultiplier = voice.freqMultiplier;
+		voice.previousTonalityLimit = voice.freqTonalityLimit;
+		voice.previousValid = !voice.customFreqMap && int(voice.previousBandMap.size()) == bands + 1;
+
+		voice.freqMultiplier = multiplier;
+		voice.freqTonalityLimit = freqTonalityLimit;
+		voice.customFreqMap = nullptr;
+		if (!wasPrevious) updateBandMap(voice);
+	}
+
+	// Applies the latest of each voice's scheduled transposes which the processing time has reached
+	void applyScheduledTransposes(long processingTime) {
+		for (auto &voice : voices) {
+			int due = 0;
+			while (due < voice.scheduledCount && voice.scheduled[due].inputTime <= processingTime) ++due;
+			if (due == 0) continue;
+			const auto &latest = voice.scheduled[due - 1];
+			applyTranspose(voice, latest.multiplier, latest.tonalityLimit);
+			std::move(voice.scheduled.begin() + due, voice.scheduled.begin() + voice.scheduledCount, voice.scheduled.begin());
+			voice.scheduledCount -= due;
+		}
+	}
+
+	// Samples a voice's frequency map at every band, so mapping the peaks doesn't have to evaluate it (which for a custom map is an indirect call)
+	void updateBandMap(Voice &voice) {
+		if (bands <= 0) return; // not configured yet
+		voice.bandMap.resize(bands + 1);
+		for (int b = 0; b <= bands; ++b) {
+			voice.bandMap[b] = freqToBand(voice.mapFreq(bandToFreq(b)));
+		}
+	}
+
+	// Maps the (shared) peaks through a voice's frequency map, interpolating between the bands it was sampled at
+	void mapPeaks(Voice &voice) {
+		voice.peaks.resize(0);
+		const Sample *bandMap = voice.bandMap.data();
+		for (Sample avgBand : peakBands) {
+			int index = std::min<int>(int(avgBand), bands - 1);
+			Sample fraction = avgBand - index;
+			voice.peaks.emplace_back(Peak{avgBand, bandMap[index] + (bandMap[index + 1] - bandMap[index])*fraction});
+		}
+	}
+
+	void updateOutputMap(Voice &voice) {
+		auto &peaks = voice.peaks;
+		auto &outputMap = voice.outputMap;
 		if (peaks.empty()) {
 			for (int b = 0; b < bands; ++b) {
 				outputMap[b] = {Sample(b), 1};
@@ -630,4 +1226,4 @@ private:
 };
 
 }} // namespace
-#endif // include guard
+#endif // include guard
\ No newline at end of file